@@ -0,0 +1,133 @@
+/**
+ * @file attacks.cpp
+ * @author Ondrej
+ * @brief Precomputed attack tables for all piece types
+ *
+*/
+
+#include "attacks.hpp"
+
+#include <vector>
+#include <algorithm>
+
+/** Tells whether the CPU has PEXT and the binary is compiled to use it */
+static bool detectPext(void)
+{
+#if defined(__BMI2__)
+  return __builtin_cpu_supports("bmi2");
+#else
+  return false;
+#endif
+}
+
+bool hasPext = detectPext();
+
+template <int Width, int Height>
+std::array<Magic, Attacks<Width, Height>::SQUARE_COUNT> Attacks<Width, Height>::rookMagics;
+
+template <int Width, int Height>
+std::array<Magic, Attacks<Width, Height>::SQUARE_COUNT> Attacks<Width, Height>::bishopMagics;
+
+/** Xorshift random generator, fixed seed so the magics are the same on every run */
+static Bitboard randomBB(Bitboard & state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+/** Returns squares whose occupancy changes the attacks (last square of each ray does not) */
+template <typename B, size_t N>
+static Bitboard relevantMask(Square sq, const std::array<Position, N> & directions)
+{
+  Bitboard mask = 0;
+  for (const auto & dir: directions)
+  {
+    Position pos = Position(B::fileOf(sq) + dir.first, B::rankOf(sq) + dir.second);
+    while (B::isOnBoard(Position(pos.first + dir.first, pos.second + dir.second)))
+    {
+      mask |= squareBB(B::toSquare(pos));
+      pos = Position(pos.first + dir.first, pos.second + dir.second);
+    }
+  }
+  return mask;
+}
+
+/** Finds magic numbers and fills attack table of one sliding piece */
+template <typename B, size_t N>
+static void initMagics(std::array<Magic, B::SQUARE_COUNT> & magics, std::vector<Bitboard> & table, const std::array<Position, N> & directions)
+{
+  // Table is allocated first so the pointers into it stay valid
+  size_t size = 0;
+  for (Square sq = 0; sq < B::SQUARE_COUNT; sq ++)
+    size += size_t(1) << popCount(relevantMask<B>(sq, directions));
+  table.assign(size, 0);
+
+  Bitboard state = 0x9E3779B97F4A7C15ULL;
+  std::vector<Bitboard> occupancies;
+  std::vector<Bitboard> reference;
+  std::vector<unsigned> usedIn;
+  size_t offset = 0;
+
+  for (Square sq = 0; sq < B::SQUARE_COUNT; sq ++)
+  {
+    Magic & m = magics[sq];
+    m.mask = relevantMask<B>(sq, directions);
+    int bits = popCount(m.mask);
+    m.shift = 64 - std::max(bits, 1);
+    Bitboard * attacks = table.data() + offset;
+    m.attacks = attacks;
+
+    // Enumerate all subsets of the mask (Carry-Rippler trick)
+    occupancies.clear();
+    reference.clear();
+    Bitboard subset = 0;
+    do
+    {
+      occupancies.push_back(subset);
+      reference.push_back(slidingAttacks<B>(sq, subset, directions));
+      subset = (subset - m.mask) & m.mask;
+    } while (subset);
+
+    // Try random sparse numbers until every occupancy maps to a slot without destructive collision
+    // PEXT index is collision free, so with PEXT the first try always succeeds
+    usedIn.assign(size_t(1) << bits, 0);
+    for (unsigned attempt = 1; ; attempt ++)
+    {
+      m.magic = hasPext ? 0 : randomBB(state) & randomBB(state) & randomBB(state);
+      bool found = true;
+      for (size_t i = 0; i < occupancies.size() && found; i ++)
+      {
+        unsigned index = m.index(occupancies[i]);
+        if (usedIn[index] != attempt)
+        {
+          usedIn[index] = attempt;
+          attacks[index] = reference[i];
+        }
+        else if (attacks[index] != reference[i])
+          found = false;
+      }
+
+      if (found)
+        break;
+    }
+
+    offset += size_t(1) << bits;
+  }
+}
+
+/** Finds the magics and fills the sliding attacks */
+template <int Width, int Height>
+void Attacks<Width, Height>::build(void)
+{
+  // Storage for the sliding attacks, Magic::attacks points inside
+  static std::vector<Bitboard> rookTable;
+  static std::vector<Bitboard> bishopTable;
+
+  initMagics<B>(rookMagics, rookTable, ROOK_MOVES);
+  initMagics<B>(bishopMagics, bishopTable, BISHOP_MOVES);
+}
+
+#define INSTANTIATE_ATTACKS(width, height) template struct Attacks<width, height>;
+FOR_EACH_BOARD_SIZE(INSTANTIATE_ATTACKS)
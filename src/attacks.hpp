@@ -0,0 +1,183 @@
+/**
+ * @file attacks.hpp
+ * @author Ondrej
+ * @brief Precomputed attack tables for all piece types
+ *
+*/
+
+#pragma once
+
+#include "bitboard.hpp"
+
+#include <array>
+#include <cstddef>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+constexpr std::array<Position, 8> KING_MOVES = {{
+  {-1,1}, {0,1}, {1,1}, {1,0}, {1,-1}, {0,-1}, {-1,-1}, {-1,0}
+}};
+
+constexpr std::array<Position, 4> ROOK_MOVES = {{
+  {1,0}, {-1,0}, {0,1}, {0,-1}
+}};
+
+constexpr std::array<Position, 4> BISHOP_MOVES = {{
+  {1,1}, {1,-1}, {-1,-1}, {-1,1}
+}};
+
+constexpr std::array<Position, 8> KNIGHT_MOVES = {{
+  {1,2}, {2,1}, {2,-1}, {1,-2}, {-1,-2}, {-2,-1}, {-2,1}, {-1,2}
+}};
+
+// Pawn captures, indexed by color (white pawns go up)
+constexpr std::array<std::array<Position, 2>, 2> PAWN_CAPTURES = {{
+  {{{-1,1}, {1,1}}},
+  {{{-1,-1}, {1,-1}}}
+}};
+
+/** Returns squares attacked by sliding piece in given directions, each ray ends at the first occupied square (included) */
+template <typename B, size_t N>
+constexpr Bitboard slidingAttacks(Square sq, Bitboard occupied, const std::array<Position, N> & directions)
+{
+  Bitboard attacks = 0;
+  for (const auto & dir: directions)
+  {
+    Position pos = Position(B::fileOf(sq) + dir.first, B::rankOf(sq) + dir.second);
+    while (B::isOnBoard(pos))
+    {
+      Bitboard bb = squareBB(B::toSquare(pos));
+      attacks |= bb;
+      if (occupied & bb)
+        break;
+      pos = Position(pos.first + dir.first, pos.second + dir.second);
+    }
+  }
+  return attacks;
+}
+
+/** Sliding attack lookup for one square (magic bitboard, or PEXT when compiled with BMI2 and the CPU supports it) */
+struct Magic
+{
+  // Relevant occupancy (edges of the rays do not matter)
+  Bitboard mask;
+  Bitboard magic;
+  const Bitboard * attacks;
+  unsigned shift;
+
+  /** Returns index of the occupancy into the attack table */
+  unsigned index(Bitboard occupied) const;
+};
+
+// Set at startup if the PEXT instruction can be used
+extern bool hasPext;
+
+inline unsigned Magic::index(Bitboard occupied) const
+{
+#if defined(__BMI2__)
+  if (hasPext)
+    return static_cast<unsigned>(_pext_u64(occupied, mask));
+#endif
+  return static_cast<unsigned>(((occupied & mask) * magic) >> shift);
+}
+
+/* Attack tables of one board size. Step attacks and lines are computed at compile time, sliding attacks are filled
+   when the first game of the size is created (attacks.cpp), so programs pay only for the sizes they use */
+template <int Width, int Height>
+struct Attacks
+{
+  using B = Board<Width, Height>;
+  static constexpr int SQUARE_COUNT = B::SQUARE_COUNT;
+
+  using AttackTable = std::array<Bitboard, SQUARE_COUNT>;
+  using SquarePairTable = std::array<std::array<Bitboard, SQUARE_COUNT>, SQUARE_COUNT>;
+
+  /** Returns table of squares reachable by single step in given directions from each square */
+  template <size_t N>
+  static constexpr AttackTable stepAttackTable(const std::array<Position, N> & directions)
+  {
+    AttackTable table = {};
+    for (Square sq = 0; sq < SQUARE_COUNT; sq ++)
+    {
+      for (const auto & dir: directions)
+      {
+        Position pos = Position(B::fileOf(sq) + dir.first, B::rankOf(sq) + dir.second);
+        if (B::isOnBoard(pos))
+          table[sq] |= squareBB(B::toSquare(pos));
+      }
+    }
+    return table;
+  }
+
+  /** Returns table of squares strictly between two squares (or the whole line through them if line is set), empty if not aligned */
+  static constexpr SquarePairTable squarePairTable(bool line)
+  {
+    constexpr std::array<Position, 8> directions = {{
+      {1,0}, {-1,0}, {0,1}, {0,-1}, {1,1}, {1,-1}, {-1,-1}, {-1,1}
+    }};
+
+    SquarePairTable table = {};
+    for (Square sq1 = 0; sq1 < SQUARE_COUNT; sq1 ++)
+    {
+      for (const auto & dir: directions)
+      {
+        Bitboard ray = 0;
+        Bitboard fullLine = squareBB(sq1) | slidingAttacks<B>(sq1, 0, std::array<Position, 2>{{dir, {-dir.first, -dir.second}}});
+        Position pos = Position(B::fileOf(sq1) + dir.first, B::rankOf(sq1) + dir.second);
+        while (B::isOnBoard(pos))
+        {
+          Square sq2 = B::toSquare(pos);
+          table[sq1][sq2] = line ? fullLine : ray;
+          ray |= squareBB(sq2);
+          pos = Position(pos.first + dir.first, pos.second + dir.second);
+        }
+      }
+    }
+    return table;
+  }
+
+  static constexpr AttackTable KING = stepAttackTable(KING_MOVES);
+  static constexpr AttackTable KNIGHT = stepAttackTable(KNIGHT_MOVES);
+
+  // Pawn captures indexed by [Color][Square]
+  static constexpr std::array<AttackTable, 2> PAWN = {stepAttackTable(PAWN_CAPTURES[0]), stepAttackTable(PAWN_CAPTURES[1])};
+
+  // Squares between two squares and the whole line going through them
+  static constexpr SquarePairTable BETWEEN = squarePairTable(false);
+  static constexpr SquarePairTable LINE = squarePairTable(true);
+
+  static std::array<Magic, SQUARE_COUNT> rookMagics;
+  static std::array<Magic, SQUARE_COUNT> bishopMagics;
+
+  /** Fills the sliding attacks on the first call, later calls return at once (thread safe) */
+  static void init(void)
+  {
+    static const bool initialized = (build(), true);
+    (void) initialized;
+  }
+
+  /** Finds the magics and fills the sliding attacks */
+  static void build(void);
+
+  /** Returns rook attacks from square for given occupancy */
+  static Bitboard rook(Square sq, Bitboard occupied)
+  {
+    const Magic & m = rookMagics[sq];
+    return m.attacks[m.index(occupied)];
+  }
+
+  /** Returns bishop attacks from square for given occupancy */
+  static Bitboard bishop(Square sq, Bitboard occupied)
+  {
+    const Magic & m = bishopMagics[sq];
+    return m.attacks[m.index(occupied)];
+  }
+
+  /** Returns queen attacks from square for given occupancy */
+  static Bitboard queen(Square sq, Bitboard occupied)
+  {
+    return rook(sq, occupied) | bishop(sq, occupied);
+  }
+};
@@ -0,0 +1,334 @@
+/**
+ * @file bench.cpp
+ * @author Ondrej
+ * @brief Searches fixed set of positions and compares the results with saved baseline
+ *
+*/
+
+#include "engine.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Result of searching one position
+struct BenchResult
+{
+  std::string fen;
+  std::string bestMove;
+  std::uint64_t nodes = 0;
+  double seconds = 0;
+  SearchStats stats;
+};
+
+/** Returns positions used by the benchmark */
+static std::vector<std::string> benchPositions(void)
+{
+  std::vector<std::string> positions;
+  using Game = Chess<5, 5>;
+  for (const auto & setup: {Game::simpleSetup1(), Game::simpleSetup2(), Game::simpleSetup3()})
+  {
+    positions.push_back(Game(setup, Color::White).fen());
+    positions.push_back(Game(setup, Color::Black).fen());
+  }
+
+  // Gardner minichess start, pawn ending and a few endgames
+  positions.push_back("rnbqk/ppppp/5/PPPPP/RNBQK w");
+  positions.push_back("2k2/1ppp1/5/1PPP1/2K2 w");
+  positions.push_back("k4/5/5/5/R3K w");
+  positions.push_back("4k/5/2K2/5/Q4 w");
+  positions.push_back("k1q2/5/2N2/1B3/K3R b");
+  positions.push_back("1k3/1p1r1/5/2BP1/K3R w");
+  return positions;
+}
+
+// Settings shared by all searched positions
+struct BenchOptions
+{
+  SearchLimits limits;
+  SearchOptions search;
+  int threads = 1;
+  size_t hash = 16;
+  std::string tablebases;
+  std::string network;
+};
+
+/** Searches position with engine made for its board size, returns false if the FEN is invalid */
+template <int Width, int Height>
+static bool searchPosition(const std::string & fen, const BenchOptions & options, BenchResult & result)
+{
+  Chess<Width, Height> game;
+  if (!game.loadFen(fen))
+    return false;
+
+  // Every position gets new engine (empty table) so the results do not depend on the order
+  Engine<Width, Height> engine(options.hash);
+  engine.setThreads(options.threads);
+  engine.setOptions(options.search);
+  if (!options.tablebases.empty())
+  {
+    size_t loaded = engine.loadTablebases(options.tablebases);
+    static bool reported = false;
+    if (!reported)
+      std::cout << "Loaded " << loaded << " endgame tables for " << Width << "x" << Height << " board" << std::endl;
+    reported = true;
+  }
+  if (!options.network.empty())
+  {
+    bool loaded = engine.loadNetwork(options.network);
+    static bool reported = false;
+    if (!reported)
+      std::cout << (loaded ? "Loaded" : "No") << " evaluation network for " << Width << "x" << Height << " board" << std::endl;
+    reported = true;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  SearchResult search = engine.findBestMove(game, options.limits);
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  result.fen = fen;
+  result.bestMove = search.move ? game.moveToString(search.move) : "none";
+  result.nodes = search.stats.nodes;
+  result.stats = search.stats;
+  return true;
+}
+
+/** Saves results as baseline for later runs */
+static bool saveBaseline(const std::string & filename, const std::vector<BenchResult> & results, std::uint64_t nodes, double seconds)
+{
+  std::ofstream file(filename);
+  if (!file)
+    return false;
+
+  file << "signature " << nodes << std::endl;
+  file << "nps " << static_cast<std::uint64_t>(nodes / seconds) << std::endl;
+  for (const auto & result: results)
+    file << "position " << result.nodes << " " << result.bestMove << " " << result.fen << std::endl;
+  return static_cast<bool>(file);
+}
+
+/** Compares results with saved baseline, returns false if the file can not be read, the search behaves differently or the speed dropped */
+static bool compareBaseline(const std::string & filename, const std::vector<BenchResult> & results, std::uint64_t nodes, double seconds, double tolerance)
+{
+  std::ifstream file(filename);
+  if (!file)
+  {
+    std::cerr << "Can not read baseline " << filename << std::endl;
+    return false;
+  }
+
+  std::uint64_t baseSignature = 0;
+  std::uint64_t baseNps = 0;
+  std::vector<BenchResult> base;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream parse(line);
+    std::string key;
+    parse >> key;
+    if (key == "signature")
+      parse >> baseSignature;
+    else if (key == "nps")
+      parse >> baseNps;
+    else if (key == "position")
+    {
+      BenchResult result;
+      parse >> result.nodes >> result.bestMove >> std::ws;
+      std::getline(parse, result.fen);
+      base.push_back(result);
+    }
+  }
+
+  bool ok = true;
+  std::cout << std::endl << "Comparison with " << filename << ":" << std::endl;
+
+  // Different node count means that the search itself changed, not only its speed
+  if (baseSignature != nodes)
+  {
+    std::cout << "  CHANGED signature " << baseSignature << " -> " << nodes << std::endl;
+    ok = false;
+  }
+  for (size_t i = 0; i < results.size() && i < base.size(); i ++)
+  {
+    if (base[i].fen != results[i].fen)
+      std::cout << "  position " << i + 1 << " differs from baseline, position set changed" << std::endl;
+    else if (base[i].nodes != results[i].nodes || base[i].bestMove != results[i].bestMove)
+      std::cout << "  CHANGED position " << i + 1 << ": " << base[i].bestMove << " " << base[i].nodes << " nodes -> "
+                << results[i].bestMove << " " << results[i].nodes << " nodes" << std::endl;
+  }
+
+  auto nps = static_cast<std::uint64_t>(nodes / seconds);
+  double change = baseNps ? 100.0 * (static_cast<double>(nps) - baseNps) / baseNps : 0;
+  std::cout << "  nps " << baseNps << " -> " << nps << " (" << std::showpos << std::fixed << std::setprecision(1) << change
+            << std::noshowpos << "%)" << std::endl;
+  if (change < -tolerance)
+  {
+    std::cout << "  REGRESSION speed dropped more than " << tolerance << "%" << std::endl;
+    ok = false;
+  }
+
+  std::cout << (ok ? "  OK" : "  FAILED") << std::endl;
+  return ok;
+}
+
+/** Switches off technique of the search given by its name, returns false if there is no such technique */
+static bool disableTechnique(const std::string & name, SearchOptions & search)
+{
+  if (name == "pvs")
+    search.pvs = false;
+  else if (name == "aspiration")
+    search.aspiration = false;
+  else if (name == "nullmove")
+    search.nullMove = false;
+  else if (name == "lmr")
+    search.lateMoveReductions = false;
+  else if (name == "futility")
+    search.futility = false;
+  else if (name == "rfp")
+    search.reverseFutility = false;
+  else
+    return false;
+  return true;
+}
+
+/** Prints how to use the program */
+static void printUsage(void)
+{
+  std::cerr << "Usage: bench [-depth <n>] [-nodes <n>] [-threads <n>] [-hash <mb>] [-tablebases <dir>] [-nnue <file>] [-disable <technique>] [-save <file>] [-compare <file>] [-tolerance <percent>]" << std::endl
+            << "  -depth      search every position to fixed depth (default 10)" << std::endl
+            << "  -nodes      search every position until node limit instead" << std::endl
+            << "  -threads    number of search threads (signature is stable only with one)" << std::endl
+            << "  -hash       transposition table size in megabytes" << std::endl
+            << "  -tablebases directory with endgame tables (signature changes with them)" << std::endl
+            << "  -nnue       evaluation network used instead of the handcrafted evaluation" << std::endl
+            << "  -disable    switch off pvs, aspiration, nullmove, lmr, futility or rfp (can be repeated)" << std::endl
+            << "  -save       write results to baseline file" << std::endl
+            << "  -compare    compare results with baseline file" << std::endl
+            << "  -tolerance  allowed speed drop against baseline in percent (default 5)" << std::endl;
+}
+
+/**
+ * @ Runs the benchmark
+ * - Arguments : options described in printUsage
+*/
+int main(int argc, char ** argv)
+{
+  BenchOptions options;
+  options.limits.depth = 10;
+  double tolerance = 5;
+  std::string saveFile;
+  std::string compareFile;
+
+  for (int i = 1; i < argc; i ++)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+
+    std::istringstream parse(argv[++ i]);
+    bool parsed = true;
+    if (arg == "-depth")
+      parsed = static_cast<bool>(parse >> options.limits.depth);
+    else if (arg == "-nodes")
+    {
+      parsed = static_cast<bool>(parse >> options.limits.nodes);
+      options.limits.depth = MAX_DEPTH;
+    }
+    else if (arg == "-threads")
+      parsed = static_cast<bool>(parse >> options.threads);
+    else if (arg == "-hash")
+      parsed = static_cast<bool>(parse >> options.hash);
+    else if (arg == "-tolerance")
+      parsed = static_cast<bool>(parse >> tolerance);
+    else if (arg == "-save")
+      saveFile = argv[i];
+    else if (arg == "-compare")
+      compareFile = argv[i];
+    else if (arg == "-tablebases")
+      options.tablebases = argv[i];
+    else if (arg == "-nnue")
+      options.network = argv[i];
+    else if (arg == "-disable")
+      parsed = disableTechnique(argv[i], options.search);
+    else
+      parsed = false;
+
+    if (!parsed)
+    {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<BenchResult> results;
+  std::uint64_t totalNodes = 0;
+  double totalSeconds = 0;
+
+  std::cout << " #  " << std::left << std::setw(30) << "position" << std::setw(8) << "move" << std::right << std::setw(12)
+            << "nodes" << std::setw(12) << "time [ms]" << std::setw(12) << "nps" << std::setw(9) << "seldepth" << std::setw(7)
+            << "ebf" << std::setw(10) << "1st cut" << std::setw(10) << "qsearch" << std::setw(10) << "tt hits" << std::endl;
+
+  std::vector<std::string> positions = benchPositions();
+  for (size_t i = 0; i < positions.size(); i ++)
+  {
+    // Positions can be on different boards, the size is given by the ranks of the FEN
+    int width = 0;
+    int height = 0;
+    BenchResult result;
+    bool valid = false;
+    if (fenBoardSize(positions[i], width, height))
+    {
+      withBoardSize(width, height, [&]<int Width, int Height>(Board<Width, Height>)
+      {
+        valid = searchPosition<Width, Height>(positions[i], options, result);
+      });
+    }
+    if (!valid)
+    {
+      std::cerr << "Invalid position " << positions[i] << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    double seconds = result.seconds;
+    results.push_back(result);
+    totalNodes += result.nodes;
+    totalSeconds += seconds;
+
+    std::cout << std::setw(2) << i + 1 << "  " << std::left << std::setw(30) << result.fen << std::setw(8) << result.bestMove
+              << std::right << std::setw(12) << result.nodes << std::setw(12) << std::fixed << std::setprecision(1)
+              << seconds * 1000 << std::setw(12) << static_cast<std::uint64_t>(seconds > 0 ? result.nodes / seconds : 0)
+              << std::setw(9) << result.stats.selectiveDepth << std::setw(7) << std::setprecision(2) << result.stats.effectiveBranchingFactor
+              << std::setw(9) << std::setprecision(1) << result.stats.firstMoveCutoffRate() * 100 << "%" << std::setw(9)
+              << (result.nodes ? 100.0 * result.stats.quiescenceNodes / result.nodes : 0) << "%" << std::setw(10)
+              << result.stats.ttHits << std::endl;
+  }
+
+  totalSeconds = std::max(totalSeconds, 1e-9);
+  std::cout << std::endl << "Total time [ms]: " << std::fixed << std::setprecision(1) << totalSeconds * 1000 << std::endl
+            << "Nodes searched:  " << totalNodes << std::endl
+            << "Nodes/second:    " << static_cast<std::uint64_t>(totalNodes / totalSeconds) << std::endl
+            << "Signature:       " << totalNodes << std::endl;
+
+  if (!saveFile.empty())
+  {
+    if (!saveBaseline(saveFile, results, totalNodes, totalSeconds))
+    {
+      std::cerr << "Can not write baseline " << saveFile << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << "Baseline saved to " << saveFile << std::endl;
+  }
+
+  if (!compareFile.empty() && !compareBaseline(compareFile, results, totalNodes, totalSeconds, tolerance))
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file bitboard.hpp
+ * @author Ondrej
+ * @brief Bitboard type, square helpers of each board size and dispatch to the supported sizes
+ *
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <bit>
+#include <utility>
+
+// Supported board sizes, every size gets its own compiled code (see withBoardSize)
+constexpr int MIN_BOARD_SIZE = 4;
+constexpr int MAX_BOARD_SIZE = 8;
+
+// Board used when no size is given
+constexpr int DEFAULT_BOARD_SIZE = 5;
+
+// Position on chess board
+using Position = std::pair<int, int>;
+
+// One bit per square, bit index is y * width + x (bit 0 = bottom left corner)
+using Bitboard = std::uint64_t;
+
+// Index of a square on the board
+using Square = int;
+
+// Most squares a board can have
+constexpr int MAX_SQUARES = 64;
+
+/** Returns bitboard with only given square set */
+constexpr Bitboard squareBB(Square sq)
+{
+  return Bitboard(1) << sq;
+}
+
+/** Returns number of set bits */
+constexpr int popCount(Bitboard bb)
+{
+  return std::popcount(bb);
+}
+
+/** Returns the least significant set square, bitboard must not be empty */
+constexpr Square lsb(Bitboard bb)
+{
+  return std::countr_zero(bb);
+}
+
+/** Removes the least significant set square from bitboard and returns it */
+constexpr Square popLsb(Bitboard & bb)
+{
+  Square sq = lsb(bb);
+  bb &= bb - 1;
+  return sq;
+}
+
+/* Geometry of board with given width and height, everything is known at compile time */
+template <int Width, int Height>
+struct Board
+{
+  static_assert(Width > 0 && Height > 0 && Width * Height <= MAX_SQUARES, "Board does not fit into 64 bit bitboard");
+
+  static constexpr int WIDTH = Width;
+  static constexpr int HEIGHT = Height;
+  static constexpr int SQUARE_COUNT = Width * Height;
+
+  // Mask of all squares that are on the board
+  static constexpr Bitboard BOARD_BB = SQUARE_COUNT == 64 ? ~Bitboard(0) : (Bitboard(1) << SQUARE_COUNT) - 1;
+
+  // Edges of the board
+  static constexpr Bitboard FIRST_RANK_BB = (Bitboard(1) << Width) - 1;
+  static constexpr Bitboard LAST_RANK_BB = FIRST_RANK_BB << (Width * (Height - 1));
+  static constexpr Bitboard FIRST_FILE_BB = BOARD_BB / FIRST_RANK_BB;
+  static constexpr Bitboard LAST_FILE_BB = FIRST_FILE_BB << (Width - 1);
+
+  /** Returns square from X and Y coordinates */
+  static constexpr Square makeSquare(int x, int y)
+  {
+    return y * Width + x;
+  }
+
+  /** Returns X coordinate of square */
+  static constexpr int fileOf(Square sq)
+  {
+    return sq % Width;
+  }
+
+  /** Returns Y coordinate of square */
+  static constexpr int rankOf(Square sq)
+  {
+    return sq / Width;
+  }
+
+  /** Converts position to square index */
+  static constexpr Square toSquare(Position pos)
+  {
+    return makeSquare(pos.first, pos.second);
+  }
+
+  /** Converts square index to position */
+  static constexpr Position toPosition(Square sq)
+  {
+    return {fileOf(sq), rankOf(sq)};
+  }
+
+  /** Checks if position is inside of the board */
+  static constexpr bool isOnBoard(Position pos)
+  {
+    return pos.first >= 0 && pos.first < Width && pos.second >= 0 && pos.second < Height;
+  }
+};
+
+/** Returns true if the board size has compiled code */
+constexpr bool isSupportedBoard(int width, int height)
+{
+  return width == height && width >= MIN_BOARD_SIZE && width <= MAX_BOARD_SIZE;
+}
+
+/** Calls function with Board<width, height>() (function is a template lambda), returns false if the size is not supported */
+template <typename Function>
+bool withBoardSize(int width, int height, Function && function)
+{
+  if (!isSupportedBoard(width, height))
+    return false;
+
+  switch (width)
+  {
+    case 4:
+      function(Board<4, 4>());
+      break;
+
+    case 5:
+      function(Board<5, 5>());
+      break;
+
+    case 6:
+      function(Board<6, 6>());
+      break;
+
+    case 7:
+      function(Board<7, 7>());
+      break;
+
+    default:
+      function(Board<8, 8>());
+      break;
+  }
+  return true;
+}
+
+/** Calls macro(width, height) for every supported board size, used for explicit instantiation of the templates */
+#define FOR_EACH_BOARD_SIZE(macro) \
+  macro(4, 4)                      \
+  macro(5, 5)                      \
+  macro(6, 6)                      \
+  macro(7, 7)                      \
+  macro(8, 8)
@@ -17,13 +17,16 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
-#include <future>
+#include <optional>
+#include <condition_variable>
+#include <cmath>
 
 /** Processes all user input */
-void BoardVisualisation::processInput(sf::Event & event)
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::processInput(sf::Event & event)
 {
   unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
-  float squareSize = (smallerWinSize - 75) / DIMENSION;
+  float squareSize = (smallerWinSize - 75) / LONGER_SIDE;
 
   /* Close window if window is closed */
   if (event.type == sf::Event::Closed)
@@ -35,6 +38,7 @@ void BoardVisualisation::processInput(sf::Event & event)
   
   else if (event.type == sf::Event::MouseButtonPressed)
   {
+    this -> refreshPosition();
     if (event.mouseButton.button == sf::Mouse::Left)
     {
       // Raw display coordinates
@@ -45,10 +49,10 @@ void BoardVisualisation::processInput(sf::Event & event)
       float YMouse = windowPos.y;
       
       // Check if any piece was clicked
-      for (const auto & [pos, piece]: m_chess.getBoard())
+      for (const auto & [pos, piece]: m_board)
       {
         size_t XPos = pos.first;
-        size_t YPos = (DIMENSION - 1 -pos.second);
+        size_t YPos = (Height - 1 -pos.second);
         float XSquare = LEFT_PADDING + XPos * squareSize;
         float YSquare = TOP_PADDING + YPos * squareSize;
         
@@ -68,6 +72,7 @@ void BoardVisualisation::processInput(sf::Event & event)
   {
     if (event.mouseButton.button == sf::Mouse::Left && m_holding.first != -1)
     {
+      this -> refreshPosition();
       // Raw display coordinates
       sf::Vector2i mousePos = sf::Mouse::getPosition(m_window);
       // Window coordinates
@@ -75,18 +80,22 @@ void BoardVisualisation::processInput(sf::Event & event)
       float XMouse = windowPos.x;
       float YMouse = windowPos.y;
       
-      Piece oldPiece = m_chess.getBoard()[m_holding];
       int newX = (XMouse - LEFT_PADDING) / squareSize;
-      int newY = DIMENSION - (YMouse - TOP_PADDING) / squareSize;
+      int newY = Height - (YMouse - TOP_PADDING) / squareSize;
       //std::cout << newX << " " << newY << std::endl;
       
-      // If placing square is indide the chess board
-      if (newX >= 0 && newX <= DIMENSION - 1 && newY >= 0 && newY <= DIMENSION - 1)
+      // If placing square is indide the chess board and the move is legal (holding is dropped when the position changes).
+      // Only the human's own turn counts, the AI searches the current position only on its turn (pondering uses a copy)
+      if (m_chess.toMove() == HUMAN_COLOR && m_holding.first != -1 && newX >= 0 && newX <= Width - 1 && newY >= 0 && newY <= Height - 1)
       {
-        // If valid move
-        if (m_chess.isValidMove(m_holding, {newX, newY}))
+        Square target = Board<Width, Height>::toSquare({newX, newY});
+        for (Move move: m_movesFrom[Board<Width, Height>::toSquare(m_holding)])
         {
-          m_chess.makeMove(m_holding, {newX, newY});
+          if (move.to() == target)
+          {
+            m_chess.makeMove(move);
+            break;
+          }
         }
       }
       m_holding.first = -1;
@@ -95,79 +104,171 @@ void BoardVisualisation::processInput(sf::Event & event)
 }
 
 /** The main loop */
-void BoardVisualisation::mainLoop(void)
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::mainLoop(void)
 {
   m_startTime = std::chrono::high_resolution_clock::now();
   unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
-  float squareSize = (smallerWinSize - 75) / DIMENSION;
-  Engine engine;
+  float squareSize = (smallerWinSize - 75) / LONGER_SIDE;
+  Engine<Width, Height> engine;
+  engine.setThreads(std::max(1u, std::thread::hardware_concurrency()));
+  std::cout << "Loaded " << engine.loadTablebases(TABLEBASE_PATH) << " endgame tables" << std::endl;
+  std::string network = std::string(NETWORK_PATH) + "/" + std::to_string(Width) + "x" + std::to_string(Height) + ".nnue";
+  if (engine.loadNetwork(network))
+    std::cout << "Loaded evaluation network " << network << std::endl;
+
+  // AI answers within time budget instead of searching to fixed depth
+  SearchLimits limits;
+  limits.time = std::chrono::milliseconds(AI_MOVE_TIME);
+
+  // Result of the search running on the engine's threads, set by the search thread when it ends
+  bool thinking = false;
+  std::mutex resultMutex;
+  std::optional<SearchResult> finishedResult;
+  std::condition_variable resultReady;
+  auto storeResult = [&resultMutex, &finishedResult, &resultReady](const SearchResult & result)
+  {
+    {
+      std::lock_guard<std::mutex> lock(resultMutex);
+      finishedResult = result;
+    }
+    resultReady.notify_one();
+  };
+
+  // AI has no move (game is over), nothing more to search
+  bool gameOver = false;
+
+  // Screen is drawn only when something on it changed, otherwise the loop sleeps until an event or the AI's move
+  bool redraw = true;
 
-  // To hold the future result
-  std::future<std::pair<Position, Position>> bestMoveFuture;
+  // While the human thinks, the AI searches the position after the move it expects (hash of that position)
+  bool pondering = false;
+  std::uint64_t ponderHash = 0;
+
+  // Hash of the position the running search was started for, its result is played only in that position
+  std::uint64_t searchHash = 0;
   
   sf::Event event;
-  sf::Clock clock;
-  float currentStepTime = 0.0f;
   while (m_window.isOpen())
   {
+    bool aiToMove = m_chess.toMove() != HUMAN_COLOR;
+    if (!redraw && !(aiToMove && !thinking && !gameOver))
+    {
+      if (aiToMove && thinking)
+      {
+        // Wakes up at once when the AI's move is ready, events are still handled every few milliseconds
+        std::unique_lock<std::mutex> lock(resultMutex);
+        resultReady.wait_for(lock, std::chrono::milliseconds(EVENT_POLL_INTERVAL), [&finishedResult]() {return finishedResult.has_value();});
+      }
+      else if (m_window.waitEvent(event))
+      {
+        this -> processInput(event);
+        redraw = this -> changesScreen(event);
+      }
+    }
+
     while (m_window.pollEvent(event))
     {
       this -> processInput(event);
+      redraw = this -> changesScreen(event) || redraw;
     }
 
-    m_window.clear(sf::Color(39,36,33,255));
-    
-    showBoard();
-     
-    // If black plays, let AI make move
-    if (m_chess.toMove() == Color::White)
+    // If white plays, let AI make move (the human may have just moved)
+    if (m_chess.toMove() != HUMAN_COLOR)
     {
-      if (!bestMoveFuture.valid()) // If no current calculation is running
+      // Human played the expected move, the ponder search goes on as the real one. Otherwise it is thrown away, but what
+      // it stored in the transposition table still helps the new search
+      if (pondering)
+      {
+        pondering = false;
+        if (m_chess.hash() == ponderHash)
+        {
+          std::cout << "Ponder hit" << std::endl;
+          engine.ponderHit();
+        }
+        else
+        {
+          engine.stop();
+          engine.wait();
+          finishedResult.reset();
+          thinking = false;
+        }
+      }
+
+      if (!thinking && !gameOver) // If no current calculation is running
       {
         std::cout << "Making move (AI - White)..." << std::endl;
-        // Launch findBestMove in a separate thread
-        bestMoveFuture = std::async(std::launch::async, &Engine::findBestMove, &engine, std::ref(m_chess), 7);
+        // Search runs on the engine's threads, the loop keeps drawing
+        engine.startSearch(m_chess, limits, storeResult);
+        searchHash = m_chess.hash();
+        thinking = true;
       }
       else
       {
         // Check if the AI has finished calculating the move
-        std::chrono::seconds timeout(0);
-        if (bestMoveFuture.wait_for(timeout) == std::future_status::ready)
+        std::optional<SearchResult> finished;
         {
-          std::cout << "Move ready" << std::endl;
-          auto move = bestMoveFuture.get();
-          if (move.first != Position(-1, -1))
+          std::lock_guard<std::mutex> lock(resultMutex);
+          finished.swap(finishedResult);
+        }
+        if (finished)
+        {
+          SearchResult result = *finished;
+          const SearchStats & stats = result.stats;
+          std::cout << "Move ready: depth " << stats.depth << "/" << stats.selectiveDepth << ", eval " << result.score
+                    << ", " << stats.nodes << " nodes, " << stats.nps() << " nps" << std::endl;
+          // The AI can calculate the next move
+          thinking = false;
+
+          // Result of a search of other position is thrown away and the position is searched again
+          this -> refreshPosition();
+          const std::vector<Move> & legal = m_movesFrom[result.move.from()];
+          if (m_chess.hash() != searchHash || (result.move && std::find(legal.begin(), legal.end(), result.move) == legal.end()))
           {
-            m_chess.makeMove(move.first, move.second);
+            std::cout << "Search result does not belong to the position, searching again" << std::endl;
+            continue;
+          }
+
+          if (result.move)
+          {
+            m_chess.makeMove(result.move);
+          }
+          else
+            gameOver = true;
+          redraw = true;
+
+          // Search the expected answer on the human's time
+          if (result.ponderMove)
+          {
+            Chess<Width, Height> ponderGame = m_chess;
+            ponderGame.makeMove(result.ponderMove);
+            ponderHash = ponderGame.hash();
+            pondering = true;
+
+            SearchLimits ponderLimits = limits;
+            ponderLimits.ponder = true;
+            engine.startSearch(ponderGame, ponderLimits, storeResult);
+            searchHash = ponderHash;
+            thinking = true;
           }
-          // Reset the future so the AI can calculate the next move
-          bestMoveFuture = std::future<std::pair<Position, Position>>();
         }
       }
     }
-    /*
-    // If black plays, let AI make move
-    if (m_chess.toMove() == Color::White)
-    {
-      //std::thread thr(FindBestMove, &engine, std::ref(m_chess), 5);
-      auto move = engine.findBestMove(m_chess, 1);
-      std::cout << "Making move" << std::endl;
-      if (move.first != Position(-1, -1) && move.second != Position(-1, -1))
-        m_chess.makeMove(move.first, move.second);
-      else
-        std::cout << "No possible moves" << std::endl;
-    }*/
   
-    // If currently holding
+    if (!redraw)
+      continue;
+    redraw = false;
+
+    m_window.clear(sf::Color(39,36,33,255));
+    showBoard();
+
+    // If currently holding (the AI may have moved, so the position is checked first)
+    this -> refreshPosition();
     if (m_holding.first != -1)
     {
       // Displays hint
-      std::vector<std::pair<Position, Position>> moves = m_chess.findMoves();
-      for (const auto & move: moves)
-      {
-        if (move.first == m_holding)
-          showHint(move.second);
-      }
+      for (Move move: m_movesFrom[Board<Width, Height>::toSquare(m_holding)])
+        showHint(Board<Width, Height>::toPosition(move.to()));
 
       // Raw display coordinates
       sf::Vector2i mousePos = sf::Mouse::getPosition(m_window);
@@ -176,152 +277,212 @@ void BoardVisualisation::mainLoop(void)
       sf::Vector2f windowPos = m_window.mapPixelToCoords(mousePos);
       
       // Displays the piece on the cursor (-squareSize to adjust from offset - displaying from top left corner, not middle)
-      this -> showPieceXY(m_chess.getBoard()[m_holding], windowPos.x - squareSize / 2, windowPos.y - squareSize / 2);
+      this -> showPieceXY(m_board[m_holding], windowPos.x - squareSize / 2, windowPos.y - squareSize / 2);
     }
+
+    // Pieces, hints and the held piece in one batch
+    this -> drawSprites();
     m_window.display();
 
   }
+
+  // Ponder search runs until stopped, and its result callback must not outlive the loop
+  engine.stop();
+  engine.wait();
 }
 
-/** Loads texture from cache/file */
-std::shared_ptr<sf::Texture> BoardVisualisation::loadTexture(std::string filename)
+/** Checks if the event changes what is on the screen (mouse movement only matters while dragging a piece) */
+template <int Width, int Height>
+bool BoardVisualisation<Width, Height>::changesScreen(const sf::Event & event) const
 {
-  if (m_textureCache.find(filename) != m_textureCache.end())
-    return m_textureCache[filename];
+  if (event.type == sf::Event::MouseMoved)
+    return m_holding.first != -1;
+  return event.type != sf::Event::MouseEntered && event.type != sf::Event::MouseLeft;
+}
+
+/** Rebuilds the board snapshot and legal moves if the position changed since the last call */
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::refreshPosition(void)
+{
+  if (m_cacheValid && m_chess.hash() == m_cachedHash)
+    return;
 
-  auto texture = std::make_shared<sf::Texture>();
-  if (!texture -> loadFromFile(filename))
-    return nullptr;
+  std::map<Position, Piece> board = m_chess.getBoard();
+
+  // Held piece was taken or moved by the other side
+  if (m_holding.first != -1)
+  {
+    auto held = board.find(m_holding);
+    if (held == board.end() || held -> second.type != m_board[m_holding].type || held -> second.color != m_board[m_holding].color)
+      m_holding.first = -1;
+  }
 
-  m_textureCache[filename] = texture;
-  return texture;
+  m_cachedHash = m_chess.hash();
+  m_cacheValid = true;
+  m_board = std::move(board);
+  for (auto & moves: m_movesFrom)
+    moves.clear();
+  for (Move move: m_chess.findMoves())
+    m_movesFrom[move.from()].push_back(move);
 }
 
-/** Displays hint on board*/
-void BoardVisualisation::showHint(Position pos)
+/** Scales image down into the tile of the atlas, every pixel of the tile is average of the source pixels it covers */
+static void packTile(sf::Image & atlas, const sf::Image & image, unsigned column, unsigned row)
 {
-  unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
-  float squareSize = (smallerWinSize - 75) / DIMENSION;
-  size_t XPos = pos.first;
-  size_t YPos = (DIMENSION - 1 -pos.second);
-  sf::CircleShape dot(squareSize * 0.2f); // 20% of the square
-  dot.setFillColor(sf::Color(173, 216, 230, 120)); // Red with alpha transparency
-  dot.setOrigin(dot.getRadius(), dot.getRadius()); // center origin
-  dot.setPosition(LEFT_PADDING + XPos * squareSize + squareSize / 2,
-                  TOP_PADDING + YPos * squareSize + squareSize / 2);
-
-  m_window.draw(dot);
+  const sf::Uint8 * pixels = image.getPixelsPtr();
+  unsigned width = image.getSize().x;
+  unsigned height = image.getSize().y;
+  for (unsigned y = 0; y < PIECE_TILE_SIZE; y ++)
+  {
+    for (unsigned x = 0; x < PIECE_TILE_SIZE; x ++)
+    {
+      unsigned fromX = x * width / PIECE_TILE_SIZE;
+      unsigned toX = std::max(fromX + 1, (x + 1) * width / PIECE_TILE_SIZE);
+      unsigned fromY = y * height / PIECE_TILE_SIZE;
+      unsigned toY = std::max(fromY + 1, (y + 1) * height / PIECE_TILE_SIZE);
+
+      // Colors are weighted by alpha, so transparent pixels do not darken the edges
+      std::array<unsigned, 4> sum = {};
+      for (unsigned sourceY = fromY; sourceY < toY; sourceY ++)
+      {
+        for (unsigned sourceX = fromX; sourceX < toX; sourceX ++)
+        {
+          const sf::Uint8 * pixel = pixels + 4 * (sourceY * width + sourceX);
+          for (int channel = 0; channel < 3; channel ++)
+            sum[channel] += pixel[channel] * pixel[3];
+          sum[3] += pixel[3];
+        }
+      }
+
+      unsigned count = (toX - fromX) * (toY - fromY);
+      sf::Color color = sf::Color::Transparent;
+      if (sum[3])
+        color = sf::Color(sum[0] / sum[3], sum[1] / sum[3], sum[2] / sum[3], sum[3] / count);
+      atlas.setPixel(column * PIECE_TILE_SIZE + x, row * PIECE_TILE_SIZE + y, color);
+    }
+  }
 }
 
-/** Shows piece on exact coordinates */
-void BoardVisualisation::showPieceXY(Piece piece, size_t X, size_t Y)
+/** Packs all piece images and the hint dot into one texture, returns false if an image is missing */
+template <int Width, int Height>
+bool BoardVisualisation<Width, Height>::loadAtlas(void)
 {
-  unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
-  float squareSize = (smallerWinSize - 75) / DIMENSION;
+  // File names indexed by PieceType
+  static constexpr std::array<const char *, 6> PIECE_NAMES = {"king", "queen", "rook", "bishop", "knight", "pawn"};
 
-  std::shared_ptr<sf::Texture> texture;
-  if (piece.color == Color::White)
+  sf::Image atlas;
+  atlas.create(ATLAS_COLUMNS * PIECE_TILE_SIZE, 2 * PIECE_TILE_SIZE, sf::Color::Transparent);
+  for (unsigned row = 0; row < 2; row ++)
+  {
+    for (unsigned column = 0; column < PIECE_NAMES.size(); column ++)
     {
-      switch(piece.type)
-      {
-        case PieceType::King:
-          texture = this -> loadTexture("assets/king_white.png");
-          break;
-        
-        case PieceType::Queen:
-          texture = this -> loadTexture("assets/queen_white.png");
-          break;
-        
-        case PieceType::Rook:
-          texture = this -> loadTexture("assets/rook_white.png");
-          break;
-        
-        case PieceType::Bishop:
-          texture = this -> loadTexture("assets/bishop_white.png");
-          break;
-        
-        case PieceType::Knight:
-          texture = this -> loadTexture("assets/knight_white.png");
-          break;
-        
-        case PieceType::Pawn:
-          texture = this -> loadTexture("assets/pawn_white.png");
-          break;
-      }
+      sf::Image image;
+      if (!image.loadFromFile(std::string("assets/") + PIECE_NAMES[column] + (row ? "_black.png" : "_white.png")))
+        return false;
+      packTile(atlas, image, column, row);
     }
-    else
+  }
+
+  // Hint dot is white circle with soft edge, its color comes from the vertices. It takes 40 % of the tile like it
+  // takes 40 % of the square
+  float center = PIECE_TILE_SIZE / 2.0f;
+  float radius = PIECE_TILE_SIZE * 0.2f;
+  for (unsigned y = 0; y < PIECE_TILE_SIZE; y ++)
+  {
+    for (unsigned x = 0; x < PIECE_TILE_SIZE; x ++)
     {
-      switch(piece.type)
-      {
-        case PieceType::King:
-          texture = this -> loadTexture("assets/king_black.png");
-          break;
-        
-        case PieceType::Queen:
-          texture = this -> loadTexture("assets/queen_black.png");
-          break;
-        
-        case PieceType::Rook:
-          texture = this -> loadTexture("assets/rook_black.png");
-          break;
-        
-        case PieceType::Bishop:
-          texture = this -> loadTexture("assets/bishop_black.png");
-          break;
-        
-        case PieceType::Knight:
-          texture = this -> loadTexture("assets/knight_black.png");
-          break;
-        
-        case PieceType::Pawn:
-          texture = this -> loadTexture("assets/pawn_black.png");
-          break;
-      }
+      float distance = std::hypot(x + 0.5f - center, y + 0.5f - center);
+      float coverage = std::clamp(radius - distance + 0.5f, 0.0f, 1.0f);
+      atlas.setPixel(HINT_COLUMN * PIECE_TILE_SIZE + x, y, sf::Color(255, 255, 255, static_cast<sf::Uint8>(coverage * 255)));
     }
-    
-    texture -> setSmooth(true);
-    sf::Sprite sprite;
-    sprite = sf::Sprite(*texture);
-    sprite.setScale(squareSize / texture -> getSize().x, squareSize / texture -> getSize().y);
-    sprite.setPosition(X, Y);
-    m_window.draw(sprite);
+  }
+
+  if (!m_atlas.loadFromImage(atlas))
+    return false;
+  m_atlas.generateMipmap();
+  m_atlas.setSmooth(true);
+  return true;
+}
+
+/** Queues square of given size showing the atlas tile, tinted by color */
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::addSprite(unsigned column, unsigned row, float X, float Y, float size, sf::Color color)
+{
+  float left = column * PIECE_TILE_SIZE;
+  float top = row * PIECE_TILE_SIZE;
+  m_sprites.append(sf::Vertex(sf::Vector2f(X, Y), color, sf::Vector2f(left, top)));
+  m_sprites.append(sf::Vertex(sf::Vector2f(X + size, Y), color, sf::Vector2f(left + PIECE_TILE_SIZE, top)));
+  m_sprites.append(sf::Vertex(sf::Vector2f(X + size, Y + size), color, sf::Vector2f(left + PIECE_TILE_SIZE, top + PIECE_TILE_SIZE)));
+  m_sprites.append(sf::Vertex(sf::Vector2f(X, Y + size), color, sf::Vector2f(left, top + PIECE_TILE_SIZE)));
+}
+
+/** Draws all queued pieces and hints with one draw call */
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::drawSprites(void)
+{
+  m_window.draw(m_sprites, &m_atlas);
+  m_sprites.clear();
+}
+
+/** Displays hint on board (queued, drawn by drawSprites) */
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::showHint(Position pos)
+{
+  unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
+  float squareSize = (smallerWinSize - 75) / LONGER_SIDE;
+  size_t XPos = pos.first;
+  size_t YPos = (Height - 1 -pos.second);
+  this -> addSprite(HINT_COLUMN, 0, LEFT_PADDING + XPos * squareSize, TOP_PADDING + YPos * squareSize, squareSize,
+                    sf::Color(173, 216, 230, 120)); // Light blue with alpha transparency
+}
+
+/** Shows piece on exact coordinates (queued, drawn by drawSprites) */
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::showPieceXY(Piece piece, size_t X, size_t Y)
+{
+  unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
+  float squareSize = (smallerWinSize - 75) / LONGER_SIDE;
+  this -> addSprite(static_cast<unsigned>(piece.type), static_cast<unsigned>(piece.color), X, Y, squareSize, sf::Color::White);
 }
 
 
 /** Displays pieces on chess board */
-void BoardVisualisation::showPieces(void)
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::showPieces(void)
 {
   unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
-  float squareSize = (smallerWinSize - 75) / DIMENSION;
+  float squareSize = (smallerWinSize - 75) / LONGER_SIDE;
 
-  for (auto &[pos, piece]: m_chess.getBoard())
+  this -> refreshPosition();
+  for (const auto & [pos, piece]: m_board)
   {
     // Dont display the piece that is being held
     if (pos.first == m_holding.first && pos.second == m_holding.second)
       continue;
 
     size_t XPos = pos.first;
-    size_t YPos = (DIMENSION - 1 -pos.second);
+    size_t YPos = (Height - 1 -pos.second);
     this -> showPieceXY(piece, LEFT_PADDING + XPos * squareSize, TOP_PADDING + YPos * squareSize);
   }
   
 }
 
 /** Displays the whole board */
-void BoardVisualisation::showBoard(void)
+template <int Width, int Height>
+void BoardVisualisation<Width, Height>::showBoard(void)
 {
   unsigned int smallerWinSize = std::min(m_window.getSize().x, m_window.getSize().y);
-  float squareSize = (smallerWinSize - 75) / DIMENSION;
+  float squareSize = (smallerWinSize - 75) / LONGER_SIDE;
 
-  sf::VertexArray squares(sf::Quads, DIMENSION * DIMENSION * 4);
+  sf::VertexArray squares(sf::Quads, Width * Height * 4);
   size_t vertexIndex = 0;
 
   float X = LEFT_PADDING;
   float Y = TOP_PADDING;
 
-  for (size_t i = 0; i < DIMENSION; i ++)
+  for (size_t i = 0; i < Height; i ++)
   {
-    for (size_t j = 0; j < DIMENSION; j ++)
+    for (size_t j = 0; j < Width; j ++)
     {
       sf::Color color;
       /* Decide colour based on square positon */
@@ -360,4 +521,5 @@ void BoardVisualisation::showBoard(void)
 
 }
 
-
+#define INSTANTIATE_BOARD_VISUALISATION(width, height) template class BoardVisualisation<width, height>;
+FOR_EACH_BOARD_SIZE(INSTANTIATE_BOARD_VISUALISATION)
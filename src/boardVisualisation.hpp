@@ -10,6 +10,7 @@
 #include "chess.hpp"
 
 #include <SFML/Graphics.hpp>
+#include <algorithm>
 #include <vector>
 #include <array>
 #include <map>
@@ -17,8 +18,7 @@
 #include <unordered_map>
 #include <memory>
 #include <chrono>
-
-#define DIMENSION 5 // board size
+#include <cstdint>
 
 #define TOP_PADDING_TEXT 20.0f
 #define LEFT_PADDING_TEXT 15.0f
@@ -29,6 +29,15 @@
 #define GRAPH_SIZE_X 450.0f
 #define GRAPH_SIZE_Y 300.0f
 
+#define PIECE_TILE_SIZE 256 // size of one piece image in the texture atlas in pixels (images are scaled down to it)
+
+#define AI_MOVE_TIME 1000 // time AI has for one move in milliseconds
+#define EVENT_POLL_INTERVAL 5 // how often events are checked while the AI thinks in milliseconds
+#define TABLEBASE_PATH "tablebases" // directory with endgame tables made by tbgen
+#define NETWORK_PATH "networks" // directory with evaluation networks named by board size (e.g. 5x5.nnue)
+
+/* Board size is a template parameter like in Chess, main picks the instance from the command line */
+template <int Width, int Height>
 class BoardVisualisation
 {
 public:
@@ -38,6 +47,8 @@ public:
   {
     m_window.setFramerateLimit(60);
     m_font.loadFromFile("assets/open_sans");
+    if (!this -> loadAtlas())
+      std::cerr << "Could not load piece images from assets" << std::endl;
   }
 
   /** Processes the user input during visualisation */
@@ -46,13 +57,13 @@ public:
   /** The main visualisation loop */
   void mainLoop(void);
 
-  /** Loads texture from cache/file */
-  std::shared_ptr<sf::Texture> loadTexture(std::string filename);
+  /** Packs all piece images and the hint dot into one texture, returns false if an image is missing */
+  bool loadAtlas(void);
   
-  /** Displays hint on board*/
+  /** Displays hint on board (queued, drawn by drawSprites) */
   void showHint(Position pos);
 
-  /** Shows piece on exact coordinates */
+  /** Shows piece on exact coordinates (queued, drawn by drawSprites) */
   void showPieceXY(Piece piece, size_t X, size_t Y);
 
   /** Shows pieces on chess board */
@@ -61,14 +72,36 @@ public:
   /** Displays the whole chess board */
   void showBoard(void);
   
+  /** Checks if the event changes what is on the screen (mouse movement only matters while dragging a piece) */
+  bool changesScreen(const sf::Event & event) const;
+
+  /** Draws all queued pieces and hints with one draw call */
+  void drawSprites(void);
+
+  /** Rebuilds the board snapshot and legal moves if the position changed since the last call */
+  void refreshPosition(void);
+
   /** Flips the board */
   void flipBoard(void); // will need to inverse the holding and dragging as well as all the pieces
 
 private:
+  // Color played by the human, the AI plays the other one
+  static constexpr Color HUMAN_COLOR = Color::Black;
+
+  // Squares along the longer side of the board, decides size of one square
+  static constexpr int LONGER_SIDE = std::max(Width, Height);
+
+  // Atlas has a column for every piece type (row for every color), hint dot is in the last column
+  static constexpr unsigned ATLAS_COLUMNS = 7;
+  static constexpr unsigned HINT_COLUMN = 6;
+
+  /** Queues square of given size showing the atlas tile, tinted by color */
+  void addSprite(unsigned column, unsigned row, float X, float Y, float size, sf::Color color);
+
   // Main window
   sf::RenderWindow m_window;
   
-  Chess m_chess;
+  Chess<Width, Height> m_chess;
 
   // Which color is on the bottom
   Color m_bottomPlayer;
@@ -76,7 +109,17 @@ private:
   // Currently holding piece - (-1, -1) means that no piece is being held
   Position m_holding = {-1, -1};
 
-  std::unordered_map<std::string, std::shared_ptr<sf::Texture>> m_textureCache;
+  // Snapshot of the drawn position, rebuilt only when the hash of the game changes (a move is made or undone)
+  std::uint64_t m_cachedHash = 0;
+  bool m_cacheValid = false;
+  std::map<Position, Piece> m_board;
+
+  // Legal moves of the position grouped by the square they start from, hints and drops of the held piece use them
+  std::array<std::vector<Move>, Width * Height> m_movesFrom;
+
+  // All piece images and the hint dot in one texture, and the pieces and hints queued for this frame
+  sf::Texture m_atlas;
+  sf::VertexArray m_sprites = sf::VertexArray(sf::Quads);
   sf::Font m_font;
   std::chrono::high_resolution_clock::time_point m_startTime;
 };
@@ -7,82 +7,43 @@
 
 #include "chess.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <iostream>
+#include <sstream>
 
-/** Sets up default position for white player being at bottom */
-std::map<Position, Piece> Chess::setup(void)
+// FEN letters of white pieces indexed by PieceType, black pieces use lower case
+static const std::string PIECE_LETTERS = "KQRBNP";
+
+/** Sets up default position for white player being at bottom (back rank depends on board width) */
+template <int Width, int Height>
+std::map<Position, Piece> Chess<Width, Height>::setup(void)
 {
   std::map<Position, Piece> pieces;
-  Piece piece;
 
-  /* White pieces */
-  piece.color = Color::White;
-  
-  // Rook
-  piece.type = PieceType::Rook;
-  pieces[{0,0}] =  piece;
-  pieces[{7,0}] =  piece;
-  
-  // Knight
-  piece.type = PieceType::Knight;
-  pieces[{1,0}] =  piece;
-  pieces[{6,0}] =  piece;
-  
-  // Bishop
-  piece.type = PieceType::Bishop;
-  pieces[{2,0}] =  piece;
-  pieces[{5,0}] =  piece;
-  
-  // Queen
-  piece.type = PieceType::Queen;
-  pieces[{3,0}] =  piece;
-  
-  // King
-  piece.type = PieceType::King;
-  pieces[{4,0}] =  piece;
-  
-  // Pawns
-  piece.type = PieceType::Pawn;
-  for (int i = 0; i < 8; i ++)
-    pieces[{i,1}] = piece;
-  
-  /* Black pieces */
-  piece.color = Color::Black;
-  
-  // Rook
-  piece.type = PieceType::Rook;
-  pieces[{0,7}] =  piece;
-  pieces[{7,7}] =  piece;
-  
-  // Knight
-  piece.type = PieceType::Knight;
-  pieces[{1,7}] =  piece;
-  pieces[{6,7}] =  piece;
-  
-  // Bishop
-  piece.type = PieceType::Bishop;
-  pieces[{2,7}] =  piece;
-  pieces[{5,7}] =  piece;
-  
-  // Queen
-  piece.type = PieceType::Queen;
-  pieces[{3,7}] =  piece;
-  
-  // King
-  piece.type = PieceType::King;
-  pieces[{4,7}] =  piece;
-  
+  // Standard chess on 8x8, Gardner minichess on 5x5, Los Alamos chess on 6x6 and similar rows on the other widths
+  std::string_view backRank = BACK_RANKS[std::min(Width, static_cast<int>(BACK_RANKS.size()) - 1)];
+  for (int x = 0; x < Width && x < static_cast<int>(backRank.size()); x ++)
+  {
+    PieceType type = static_cast<PieceType>(PIECE_LETTERS.find(backRank[x]));
+    pieces[{x, 0}] = {Color::White, type};
+    pieces[{x, Height - 1}] = {Color::Black, type};
+  }
+
   // Pawns
-  piece.type = PieceType::Pawn;
-  for (int i = 0; i < 8; i ++)
-    pieces[{i,6}] = piece;
+  for (int x = 0; x < Width; x ++)
+  {
+    pieces[{x, 1}] = {Color::White, PieceType::Pawn};
+    pieces[{x, Height - 2}] = {Color::Black, PieceType::Pawn};
+  }
   
   return pieces;
 }
 
 /** Simple board setup (for showcase and testing */
-std::map<Position, Piece> Chess::simpleSetup1()
+template <int Width, int Height>
+std::map<Position, Piece> Chess<Width, Height>::simpleSetup1()
 {
   std::map<Position, Piece> pieces;
   Piece piece;
@@ -108,7 +69,8 @@ std::map<Position, Piece> Chess::simpleSetup1()
 
 
 /** Simple board setup (for showcase and testing */
-std::map<Position, Piece> Chess::simpleSetup2()
+template <int Width, int Height>
+std::map<Position, Piece> Chess<Width, Height>::simpleSetup2()
 {
   std::map<Position, Piece> pieces;
   Piece piece;
@@ -134,7 +96,8 @@ std::map<Position, Piece> Chess::simpleSetup2()
 
 
 /** Simple board setup (for showcase and testing */
-std::map<Position, Piece> Chess::simpleSetup3()
+template <int Width, int Height>
+std::map<Position, Piece> Chess<Width, Height>::simpleSetup3()
 {
   std::map<Position, Piece> pieces;
   Piece piece;
@@ -159,493 +122,721 @@ std::map<Position, Piece> Chess::simpleSetup3()
 }
 
 
-Chess::Chess()
+template <int Width, int Height>
+Chess<Width, Height>::Chess()
+  : Chess((Width == 5 && Height == 5) ? simpleSetup3() : setup(), Color::White)
 {
   //m_pieces = this -> setup();
-  m_pieces = this -> simpleSetup3();
-  m_toMove = Color::White;
 }
 
-
-/** Check if the move does not put your own king at check, expects valid move on input */
-// NOTE: Not checking if new pos is not out of range, but it should not matter considering what type of operations I do here
-bool Chess::isCheck(Position pos1, Position pos2)
+/** Constructor from given pieces, pieces outside of the board are ignored */
+template <int Width, int Height>
+Chess<Width, Height>::Chess(const std::map<Position, Piece> & pieces, Color toMove)
 {
-  // Simulate move
-  std::map<Position, Piece> piecesCopy = m_pieces;
-  
-  Piece piece = piecesCopy[pos1];
-  piecesCopy.erase(pos1); // What if I erase the enemy king?
-  piecesCopy[pos2] = piece;
-  
-  Position kingPos;
-  bool found = false;
-  // Find king position
-  for (int i = 0; i < BOARD_SIZE && !found; i ++)
+  Tables::init();
+  for (const auto & [pos, piece]: pieces)
   {
-    for (int j = 0; j < BOARD_SIZE && !found; j ++)
-      if (piecesCopy.find({i,j}) != piecesCopy.end() && piecesCopy[{i,j}].type == PieceType::King 
-          && piecesCopy[{i,j}].color == piece.color)
-      {
-        kingPos = {i, j};
-        found = true;
-      }
+    if (B::isOnBoard(pos) && piece.type != PieceType::Empty)
+      this -> putPiece(B::toSquare(pos), piece);
   }
-  // Simulate all from the other color check if king is attacked
-  std::map<Position, Piece> pieces;
+  m_toMove = toMove;
+  if (m_toMove == Color::Black)
+    m_hash ^= ZOBRIST<SQUARE_COUNT>.blackToMove;
+}
 
-  // Get all pieces from the board
-  for (int i = 0; i < BOARD_SIZE; i ++)
-  {
-    for (int j = 0; j < BOARD_SIZE; j ++)
-      if (piecesCopy.find({i,j}) != piecesCopy.end() && piecesCopy[{i,j}].color != piece.color)
-        pieces[{i, j}] =  piecesCopy[{i,j}];
-  }
-  
-  // Iterate over all pieces and try all the possible moves
-  Position newPos;
-  for (const auto & [pos, piece]: pieces)
-  {
-    switch (piece.type)
-    {
-      case PieceType::King:
-        for (const auto & dir: KING_MOVES)
-        {  
-          newPos = Position(pos.first + dir.first, pos.second + dir.second);
-          if (this -> isValidKingMove(piecesCopy, pos, newPos) && kingPos == newPos)
-            return true;
-        }
-        break;
-      
-      case PieceType::Rook:
-        for (const auto & dir: ROOK_MOVES)
-        {
-          for (int i = 1; i < 3; i++)
-          {
-            newPos = Position(pos.first + i * dir.first, pos.second + i * dir.second);
-            if (this -> isValidRookMove(piecesCopy, pos, newPos) && kingPos == newPos)
-              return true;
-          }
-        }
-        break;
+/** Constructor from pieces on given squares (fast, squares have to be on the board and different) */
+template <int Width, int Height>
+Chess<Width, Height>::Chess(std::span<const std::pair<Square, Piece>> pieces, Color toMove)
+{
+  Tables::init();
+  for (const auto & [sq, piece]: pieces)
+    this -> putPiece(sq, piece);
+  m_toMove = toMove;
+  if (m_toMove == Color::Black)
+    m_hash ^= ZOBRIST<SQUARE_COUNT>.blackToMove;
+}
 
-    }
+/** Returns name of position in algebraic notation (a1 is bottom left corner) */
+std::string positionToString(Position pos)
+{
+  std::string name(1, static_cast<char>('a' + pos.first));
+  name += std::to_string(pos.second + 1);
+  return name;
+}
 
-  }
-  return false;
+/** Returns move in coordinate notation (e.g. a1a3) */
+std::string moveToString(const std::pair<Position, Position> & move)
+{
+  return positionToString(move.first) + positionToString(move.second);
 }
 
-/* If current positiong is checking */
-bool Chess::isChecking()
+/** Finds board size of FEN (number of files and ranks), returns false if the ranks differ in length */
+bool fenBoardSize(const std::string & fen, int & width, int & height)
 {
-  Position kingPos;
-  bool found = false;
-  // Find king position
-  for (int i = 0; i < BOARD_SIZE && !found; i ++)
+  std::istringstream parse(fen);
+  std::string placement;
+  parse >> placement;
+
+  width = 0;
+  height = 1;
+  int x = 0;
+  for (char c: placement)
   {
-    for (int j = 0; j < BOARD_SIZE && !found; j ++)
-      if (m_pieces.find({i,j}) != m_pieces.end() && m_pieces[{i,j}].type == PieceType::King 
-          && m_pieces[{i,j}].color == m_toMove)
-      {
-        kingPos = {i, j};
-        found = true;
-      }
+    if (c == '/')
+    {
+      if (height > 1 && x != width)
+        return false;
+      width = x;
+      x = 0;
+      height ++;
+    }
+    else if (std::isdigit(static_cast<unsigned char>(c)))
+      x += c - '0';
+    else
+      x ++;
   }
-  // Simulate all from the other color check if king is attacked
-  std::map<Position, Piece> pieces;
 
-  // Get all pieces from the board
-  for (int i = 0; i < BOARD_SIZE; i ++)
-  {
-    for (int j = 0; j < BOARD_SIZE; j ++)
-      if (m_pieces.find({i,j}) != m_pieces.end() && m_pieces[{i,j}].color != m_toMove)
-        pieces[{i, j}] =  m_pieces[{i,j}];
-  }
-  
-  // Iterate over all pieces and try all the possible moves
-  Position newPos;
-  for (const auto & [pos, piece]: pieces)
+  if (height > 1 && x != width)
+    return false;
+  width = x;
+  return width > 0;
+}
+
+/** Loads position from FEN with Height ranks (only pieces and side to move are used), returns false if FEN is invalid */
+template <int Width, int Height>
+bool Chess<Width, Height>::loadFen(const std::string & fen)
+{
+  std::istringstream parse(fen);
+  std::string placement;
+  std::string side = "w";
+  parse >> placement >> side;
+
+  // Ranks go from the top of the board
+  std::map<Position, Piece> pieces;
+  int x = 0;
+  int y = Height - 1;
+  for (char c: placement)
   {
-    switch (piece.type)
+    if (c == '/')
     {
-      case PieceType::King:
-        for (const auto & dir: KING_MOVES)
-        {  
-          newPos = Position(pos.first + dir.first, pos.second + dir.second);
-          if (this -> isValidKingMove(m_pieces, pos, newPos) && kingPos == newPos)
-            return true;
-        }
-        break;
-      
-      case PieceType::Rook:
-        for (const auto & dir: ROOK_MOVES)
-        {
-          for (int i = 1; i < 3; i++)
-          {
-            newPos = Position(pos.first + i * dir.first, pos.second + i * dir.second);
-            if (this -> isValidRookMove(m_pieces, pos, newPos) && kingPos == newPos)
-              return true;
-          }
-        }
-        break;
-
+      if (x != Width || y == 0)
+        return false;
+      x = 0;
+      y --;
+    }
+    else if (c >= '1' && c <= '9')
+      x += c - '0';
+    else
+    {
+      size_t type = PIECE_LETTERS.find(static_cast<char>(std::toupper(c)));
+      if (type == std::string::npos || x >= Width)
+        return false;
+      pieces[{x, y}] = {std::isupper(c) ? Color::White : Color::Black, static_cast<PieceType>(type)};
+      x ++;
     }
 
+    if (x > Width)
+      return false;
   }
-  return false;
-}
 
+  if (x != Width || y != 0 || (side != "w" && side != "b"))
+    return false;
 
+  *this = Chess(pieces, side == "w" ? Color::White : Color::Black);
+  return true;
+}
 
-/** Find all moves for white/black player */
-std::vector<std::pair<Position, Position>> Chess::findMoves()
+/** Returns position as FEN (pieces and side to move) */
+template <int Width, int Height>
+std::string Chess<Width, Height>::fen(void) const
 {
-  std::vector<std::pair<Position, Position>> moves; 
-  std::map<Position, Piece> pieces;
-
-  // Get all pieces from the board
-  for (int i = 0; i < BOARD_SIZE; i ++)
+  std::string fen;
+  for (int y = Height - 1; y >= 0; y --)
   {
-    for (int j = 0; j < BOARD_SIZE; j ++)
-      if (m_pieces.find({i,j}) != m_pieces.end() && m_pieces[{i,j}].color == m_toMove)
-        pieces[{i, j}] =  m_pieces[{i,j}];
-  }
-  
-  // Iterate over all pieces and try all the possible moves
-  Position newPos;
-  for (const auto & [pos, piece]: pieces)
-  {
-    switch (piece.type)
+    int empty = 0;
+    for (int x = 0; x < Width; x ++)
     {
-      case PieceType::King:
-        for (const auto & dir: KING_MOVES)
-        {
-          newPos = Position(pos.first + dir.first, pos.second + dir.second);
-          if (!(this -> isCheck(pos, newPos)) && isValidMove(pos, newPos))
-            moves.push_back({pos, newPos});
-        }
-        break;
-      
-      case PieceType::Rook:
-        for (const auto & dir: ROOK_MOVES)
-        {
-          for (int i = 1; i < 3; i++)
-          {
-            newPos = Position(pos.first + i * dir.first, pos.second + i  * dir.second);
-            if (!(this -> isCheck(pos, newPos)) && isValidMove(pos, newPos))
-              moves.push_back({pos, newPos});
-          }
-        }
-        break;
+      Piece piece = m_board[B::makeSquare(x, y)];
+      if (piece.type == PieceType::Empty)
+      {
+        empty ++;
+        continue;
+      }
+      if (empty)
+        fen += std::to_string(empty);
+      empty = 0;
+      char letter = PIECE_LETTERS[static_cast<int>(piece.type)];
+      fen += (piece.color == Color::White) ? letter : static_cast<char>(std::tolower(letter));
     }
-
+    if (empty)
+      fen += std::to_string(empty);
+    if (y > 0)
+      fen += '/';
   }
-  //std::cout << moves.size() << std::endl;
-  return moves;
+  return fen + (m_toMove == Color::White ? " w" : " b");
 }
 
-/** Validates move for pawn */
-// TODO en passant, upgrade
-bool Chess::isValidPawnMove(std::map<Position, Piece> & pieces, Position pos1, Position pos2)
+/** Returns current state of board (slow, builds the map from bitboards - meant for visualisation only) */
+template <int Width, int Height>
+std::map<Position, Piece> Chess<Width, Height>::getBoard() const
 {
-  Piece piece1 = pieces[pos1];
-  
-  // Validate moves for white pawns
-  if (piece1.color == Color::White)
-  {
-    // check one move up
-    if (pos1.first == pos2.first && pos1.second + 1 == pos2.second && pieces.find(pos2) == pieces.end())
-      return true;
-
-    // check two moves up if its the first move
-    if (pos1.first == pos2.first && pos1.second + 2 == pos2.second && pieces.find(pos2) == pieces.end() 
-        && pieces.find({pos1.first, pos1.second + 1}) == pieces.end() && pos1.second == 1)
-      return true;
-
-    // Check diagonal to left move
-    if (pos1.first - 1 == pos2.first && pos1.second + 1 == pos2.second && pieces.find(pos2) != pieces.end())
-      if (pieces[pos2].color == Color::Black)
-        return true;
-    
-    // Check diagonal to right move
-    if (pos1.first + 1 == pos2.first && pos1.second + 1 == pos2.second && pieces.find(pos2) != pieces.end())
-      if (pieces[pos2].color == Color::Black)
-        return true;
-  }
-   
-  // Validate moves for black pawns
-  else
+  std::map<Position, Piece> pieces;
+  Bitboard occupied = this -> occupied();
+  while (occupied)
   {
-    // check one move up
-    if (pos1.first == pos2.first && pos1.second - 1 == pos2.second && pieces.find(pos2) == pieces.end())
-      return true;
-
-    // check two moves up if its the first move
-    if (pos1.first == pos2.first && pos1.second - 2 == pos2.second && pieces.find(pos2) == pieces.end() 
-        && pieces.find({pos1.first, pos1.second - 1}) == pieces.end() && pos1.second == 6)
-      return true;
-
-    // Check diagonal to left move
-    if (pos1.first - 1 == pos2.first && pos1.second - 1 == pos2.second && pieces.find(pos2) != pieces.end())
-      if (pieces[pos2].color == Color::Black)
-        return true;
-    
-    // Check diagonal to right move
-    if (pos1.first + 1 == pos2.first && pos1.second - 1 == pos2.second && pieces.find(pos2) != pieces.end())
-      if (pieces[pos2].color == Color::Black)
-        return true;
+    Square sq = popLsb(occupied);
+    pieces[B::toPosition(sq)] = m_board[sq];
   }
-  
-  return false;
+  return pieces;
 }
 
-/** Validates move for king */
-// TODO Castling
-bool Chess::isValidKingMove(std::map<Position, Piece> & pieces, Position pos1, Position pos2)
+/** Returns pieces of given color attacking the square */
+template <int Width, int Height>
+Bitboard Chess<Width, Height>::attackersTo(Square sq, Color by, Bitboard occupied) const
 {
-  if (std::abs(pos1.first - pos2.first) <= 1 && std::abs(pos1.second - pos2.second) <= 1)
-  {
-    //Checks if position is empty or if oposing color is at that position
-    if (pieces.find(pos2) == pieces.end())
-      return true;
-
-    if (pieces[pos1].color != pieces[pos2].color)
-      return true;
-  }
-  return false;
+  Bitboard straight = this -> pieces(by, PieceType::Rook) | this -> pieces(by, PieceType::Queen);
+  Bitboard diagonal = this -> pieces(by, PieceType::Bishop) | this -> pieces(by, PieceType::Queen);
+
+  return (Tables::KING[sq] & this -> pieces(by, PieceType::King))
+       | (Tables::KNIGHT[sq] & this -> pieces(by, PieceType::Knight))
+       | (Tables::PAWN[static_cast<int>(opposite(by))][sq] & this -> pieces(by, PieceType::Pawn))
+       | (Tables::rook(sq, occupied) & straight)
+       | (Tables::bishop(sq, occupied) & diagonal);
 }
 
-/** Validates move for Rook */
-bool Chess::isValidRookMove(std::map<Position, Piece> & pieces, Position pos1, Position pos2)
+/** Returns all squares attacked by pieces of given color */
+template <int Width, int Height>
+Bitboard Chess<Width, Height>::attackedSquares(Color by, Bitboard occupied) const
 {
-  // Check if the move is vertical
-  if (pos1.first == pos2.first)
+  Bitboard attacks = 0;
+  Bitboard pieces = m_colorBB[static_cast<int>(by)];
+  while (pieces)
   {
-    // Check if there is clear path between the two postions
-    int step;
-    if (pos1.second > pos2.second)
-      step = -1;
-    else
-      step = 1;
-
-    for (int i = pos1.second + step; i < pos2.second; i += step)
+    Square sq = popLsb(pieces);
+    switch (m_board[sq].type)
     {
-      if (pieces.find({pos1.first, i}) != pieces.end())
-        return false;
+      case PieceType::King:
+        attacks |= Tables::KING[sq];
+        break;
+
+      case PieceType::Queen:
+        attacks |= Tables::queen(sq, occupied);
+        break;
+
+      case PieceType::Rook:
+        attacks |= Tables::rook(sq, occupied);
+        break;
+
+      case PieceType::Bishop:
+        attacks |= Tables::bishop(sq, occupied);
+        break;
+
+      case PieceType::Knight:
+        attacks |= Tables::KNIGHT[sq];
+        break;
+
+      case PieceType::Pawn:
+        attacks |= Tables::PAWN[static_cast<int>(by)][sq];
+        break;
+
+      default:
+        break;
     }
   }
- 
-  // Check if the move is horizontal
-  else if (pos1.second == pos2.second)
+  return attacks;
+}
+
+/** Returns pieces of player to move pinned to its king */
+template <int Width, int Height>
+Bitboard Chess<Width, Height>::pinnedPieces(Square king) const
+{
+  Color them = opposite(m_toMove);
+  Bitboard enemy = m_colorBB[static_cast<int>(them)];
+  Bitboard own = m_colorBB[static_cast<int>(m_toMove)];
+  Bitboard queens = this -> pieces(them, PieceType::Queen);
+
+  // Enemy sliders that would attack the king if none of our pieces were in the way
+  Bitboard snipers = (Tables::rook(king, enemy) & (this -> pieces(them, PieceType::Rook) | queens))
+                   | (Tables::bishop(king, enemy) & (this -> pieces(them, PieceType::Bishop) | queens));
+
+  Bitboard pinned = 0;
+  while (snipers)
   {
-    // Check if there is clear path between the two postions
-    int step;
-    if (pos1.first > pos2.first)
-      step = -1;
-    else
-      step = 1;
+    Bitboard blockers = Tables::BETWEEN[king][popLsb(snipers)] & own;
 
-    for (int i = pos1.first + step; i < pos2.first; i += step)
-    {
-      if (pieces.find({i, pos1.second}) != pieces.end())
-        return false;
-    }
+    // Exactly one of our pieces is in the way
+    if (popCount(blockers) == 1)
+      pinned |= blockers;
   }
-  
-  else
-    return false;
+  return pinned;
+}
 
-  //Checks if position is empty or if oposing color is at that position
-  if (pieces.find(pos2) == pieces.end())
-    return true;
+/* If current positiong is checking */
+template <int Width, int Height>
+bool Chess<Width, Height>::isChecking() const
+{
+  return this -> isInCheck(m_toMove);
+}
 
-  if (pieces[pos1].color != pieces[pos2].color)
-    return true;
-  
-  return false;
+/** Check if the king of given color is in check */
+template <int Width, int Height>
+bool Chess<Width, Height>::isInCheck(Color color) const
+{
+  Bitboard king = this -> pieces(color, PieceType::King);
+  return king && this -> attackersTo(lsb(king), opposite(color), this -> occupied());
 }
 
+/** Returns white - black evaluation in centipawns. Material, piece-square tables and game phase are kept up to date
+    by makeMove and undo, mobility and king attacks are scored by the evaluation kernel */
+template <int Width, int Height>
+int Chess<Width, Height>::fastEval() const
+{
+  TaperedScore score = m_positional[0];
+  score -= m_positional[1];
+  score += this -> pieceActivity();
+  return m_material[0] - m_material[1] + this -> taper(score);
+}
 
-/** Checks if move is valid */
-bool Chess::isValidMove(Position pos1, Position pos2)
+/** Returns white - black evaluation without mobility and king attacks, much cheaper than fastEval */
+template <int Width, int Height>
+int Chess<Width, Height>::incrementalEval() const
 {
-  /* Checks if the positions are not out of bounds of the board or if the positions are the same */
-  if (pos1.first < 0 || pos1.first > BOARD_SIZE - 1 || pos1.second < 0 || pos1.second > BOARD_SIZE - 1 || pos2.first < 0 || pos2.first > BOARD_SIZE - 1 ||
-      pos2.second < 0 || pos2.second > BOARD_SIZE - 1 || pos1 == pos2)
-    return false;
+  TaperedScore score = m_positional[0];
+  score -= m_positional[1];
+  return m_material[0] - m_material[1] + this -> taper(score);
+}
 
-  // Check if there is any piece at pos1
-  if (m_pieces.find(pos1) == m_pieces.end())
-    return false;
+/** Evaluates with the network from now on (nullptr goes back to fastEval), accumulators are computed from scratch.
+    The network has to outlive the game and all its copies */
+template <int Width, int Height>
+void Chess<Width, Height>::setNetwork(const Network * network)
+{
+  m_network = network;
+  m_refreshAccumulator = {m_network != nullptr, m_network != nullptr};
+  this -> refreshAccumulators();
+}
 
-  Piece piece1 = m_pieces[pos1];
+/** Returns white - black evaluation of the network in centipawns (has to be set). Accumulators are kept up to date by
+    makeMove and undo, so only the output layer runs */
+template <int Width, int Height>
+int Chess<Width, Height>::networkEval() const
+{
+  int us = static_cast<int>(m_toMove);
+  int eval = m_network -> evaluate(m_accumulators[us], m_accumulators[us ^ 1]);
+  return (m_toMove == Color::White) ? eval : -eval;
+}
 
-  // If the player that made the move is the one who is to move
-  if (piece1.color != m_toMove)
-    return false;
-  
-  // Check if the move does not put you in check
-  if (this -> isCheck(pos1, pos2))
-    return false;
-  
-  // Now check if the move is valid
-  switch (piece1.type)
+/** Returns network feature of piece on square seen by given player with king on given square */
+template <int Width, int Height>
+size_t Chess<Width, Height>::networkFeature(Color perspective, Square king, Piece piece, Square sq)
+{
+  // Black sees the board upside down with colors swapped
+  if (perspective == Color::Black)
   {
-    case PieceType::Pawn:
-      return isValidPawnMove(m_pieces, pos1, pos2); 
-    
-    case PieceType::King:
-      return isValidKingMove(m_pieces, pos1, pos2);
-
-    case PieceType::Rook:
-      return isValidRookMove(m_pieces, pos1, pos2);
+    king = B::makeSquare(B::fileOf(king), Height - 1 - B::rankOf(king));
+    sq = B::makeSquare(B::fileOf(sq), Height - 1 - B::rankOf(sq));
   }
-  
-  return true;
+  size_t kind = (piece.color == perspective ? 0 : 5) + static_cast<size_t>(piece.type) - 1;
+  return (static_cast<size_t>(king) * NNUE_PIECE_KINDS + kind) * SQUARE_COUNT + static_cast<size_t>(sq);
 }
 
-/** Makes move: Pos1 (from), Pos2 (to) */
-// Why is this bool?
-bool Chess::makeMove(Position pos1, Position pos2)
+/** Adds or removes feature of the piece in accumulators of both players. Moving king changes all features of its
+    player, so its accumulator is only marked to be computed again after the move */
+template <int Width, int Height>
+void Chess<Width, Height>::updateAccumulators(Square sq, Piece piece, bool add)
 {
-  Piece piece = m_pieces[pos1];
-  
-  // Default value
-  Piece capturedPiece;
-  capturedPiece.type = PieceType::Empty;
-
-  if (m_pieces.find(pos2) != m_pieces.end())
-    capturedPiece = m_pieces[pos2];
-
-
-  m_pieces.erase(pos1);
-  m_pieces[pos2] = piece;
-
-  // Change whose turn it is
-  if (m_toMove == Color::White)
-    m_toMove = Color::Black;
-  else
-    m_toMove = Color::White;
-  
-  // Save move to the log
-  Move move;
-  move.from = pos1;
-  move.to = pos2;
-  move.movedPiece = piece;
-  move.capturedPiece = capturedPiece;
-  move.wasFirstMove = false;
-
-  m_moveLog.push(move);
+  if (piece.type == PieceType::King)
+  {
+    m_refreshAccumulator[static_cast<int>(piece.color)] = true;
+    return;
+  }
 
-  return true;
+  for (int perspective = 0; perspective < 2; perspective ++)
+  {
+    if (m_refreshAccumulator[perspective])
+      continue;
+
+    // Player without king sees the board as if it stood on the first square
+    Bitboard king = this -> pieces(static_cast<Color>(perspective), PieceType::King);
+    size_t feature = networkFeature(static_cast<Color>(perspective), king ? lsb(king) : 0, piece, sq);
+    if (add)
+      m_network -> addFeature(m_accumulators[perspective], feature);
+    else
+      m_network -> removeFeature(m_accumulators[perspective], feature);
+  }
 }
 
-/** Undo the last move */
-void Chess::undo()
+/** Computes marked accumulators from scratch */
+template <int Width, int Height>
+void Chess<Width, Height>::refreshAccumulators(void)
 {
-  Move move = m_moveLog.top();
-  m_moveLog.pop();
+  for (int perspective = 0; perspective < 2; perspective ++)
+  {
+    if (!m_refreshAccumulator[perspective])
+      continue;
+    m_refreshAccumulator[perspective] = false;
 
-  m_pieces.erase(move.to);
-  m_pieces[move.from] = move.movedPiece;
+    Color color = static_cast<Color>(perspective);
+    Bitboard king = this -> pieces(color, PieceType::King);
+    Square kingSquare = king ? lsb(king) : 0;
+    m_network -> reset(m_accumulators[perspective]);
 
-  // If captured piece was no empty
-  if (move.capturedPiece.type != PieceType::Empty)
-    m_pieces[move.to] = move.capturedPiece;
-  
-  // Revert whose turn it is
-  if (m_toMove == Color::White)
-    m_toMove = Color::Black;
-  else
-    m_toMove = Color::White;
+    Bitboard pieces = this -> occupied() & ~m_typeBB[static_cast<int>(PieceType::King)];
+    while (pieces)
+    {
+      Square sq = popLsb(pieces);
+      m_network -> addFeature(m_accumulators[perspective], networkFeature(color, kingSquare, m_board[sq], sq));
+    }
+  }
 }
 
-/** Returns color of player that is about to move */
-Color Chess::toMove()
+/** Mixes middlegame and endgame score by the game phase */
+template <int Width, int Height>
+int Chess<Width, Height>::taper(const TaperedScore & score) const
 {
-  return m_toMove;
+  // Position loaded from FEN can have more pieces than the setup
+  int phase = std::min(m_phase, MAX_PHASE);
+  return (score.mg * phase + score.eg * (MAX_PHASE - phase)) / MAX_PHASE;
 }
 
-/** Returns value (0 = white, 1 = black player */
-size_t Chess::evaluate(Color color)
+/** Returns mobility and king attack score of all pieces except kings and pawns (white - black) */
+template <int Width, int Height>
+TaperedScore Chess<Width, Height>::pieceActivity(void) const
 {
-  size_t value = 0;
-  for (const auto & [pos, piece]: m_pieces)
+  Bitboard occupied = this -> occupied();
+  // All pawns of one color attack at once by shifting them diagonally
+  Bitboard whitePawns = this -> pieces(Color::White, PieceType::Pawn);
+  Bitboard blackPawns = this -> pieces(Color::Black, PieceType::Pawn);
+  std::array<Bitboard, 2> pawnAttacks = {
+    (((whitePawns & ~B::FIRST_FILE_BB) << (Width - 1)) | ((whitePawns & ~B::LAST_FILE_BB) << (Width + 1))) & B::BOARD_BB,
+    ((blackPawns & ~B::FIRST_FILE_BB) >> (Width + 1)) | ((blackPawns & ~B::LAST_FILE_BB) >> (Width - 1))
+  };
+
+  std::array<Bitboard, 2> kingZone = {};
+  for (int color = 0; color < 2; color ++)
   {
-    if (piece.color == color)
+    Bitboard king = this -> pieces(static_cast<Color>(color), PieceType::King);
+    if (king)
+      kingZone[color] = Tables::KING[lsb(king)] | king;
+  }
+
+  // Features of all pieces are collected first so the kernel scores them in one pass
+  EvalPieceList list;
+  for (int color = 0; color < 2; color ++)
+  {
+    int them = color ^ 1;
+    Bitboard safe = ~m_colorBB[color] & ~pawnAttacks[them];
+    Bitboard pieces = m_colorBB[color] & ~(m_typeBB[static_cast<int>(PieceType::King)] | m_typeBB[static_cast<int>(PieceType::Pawn)]);
+    while (pieces)
     {
-      switch (piece.type)
+      Square sq = popLsb(pieces);
+      PieceType type = m_board[sq].type;
+      Bitboard attacks = 0;
+      switch (type)
       {
-        case PieceType::Pawn:
-          value += 1;
-          break;
-        
-        case PieceType::Knight:
-          value += 3;
-          break;
-        
-        case PieceType::Bishop:
-          value += 3;
+        case PieceType::Queen:
+          attacks = Tables::queen(sq, occupied);
           break;
 
         case PieceType::Rook:
-          value += 5;
+          attacks = Tables::rook(sq, occupied);
           break;
 
-         case PieceType::Queen:
-          value += 9;
+        case PieceType::Bishop:
+          attacks = Tables::bishop(sq, occupied);
           break;
-          
-         case PieceType::King:
-          value += 0;
+
+        default:
+          attacks = Tables::KNIGHT[sq];
           break;
       }
+      list.push(static_cast<int>(type), color == 0, popCount(attacks & safe), popCount(attacks & kingZone[them]));
     }
   }
+  return scorePieces(list);
+}
 
-  return value;
+/** Find all legal moves for white/black player */
+template <int Width, int Height>
+MoveList Chess<Width, Height>::findMoves() const
+{
+  return this -> generateMoves<false>();
+}
+
+/** Find legal captures for current colour, all legal moves if the king is in check (quiescence search) */
+template <int Width, int Height>
+MoveList Chess<Width, Height>::findCaptures() const
+{
+  return this -> generateMoves<true>();
 }
 
-/** Returns white - black evaluation */
-int Chess::fastEval()
+/** Generates legal moves, only captures (or check evasions) if CapturesOnly is set */
+template <int Width, int Height>
+template <bool CapturesOnly>
+MoveList Chess<Width, Height>::generateMoves() const
 {
-  int value = 0;
-  for (const auto & [pos, piece]: m_pieces)
+  MoveList moves;
+
+  Color them = opposite(m_toMove);
+  Bitboard own = m_colorBB[static_cast<int>(m_toMove)];
+  Bitboard enemy = m_colorBB[static_cast<int>(them)];
+  Bitboard occupied = own | enemy;
+
+  // Squares non-king pieces have to move to when in check, squares king can not step on and pinned pieces
+  // Position without king has no restrictions
+  Bitboard checkMask = B::BOARD_BB;
+  Bitboard danger = 0;
+  Bitboard pinned = 0;
+  Square king = 0;
+
+  // Squares any piece (king included) can move to
+  Bitboard targetMask = CapturesOnly ? enemy : B::BOARD_BB;
+
+  Bitboard kingBB = this -> pieces(m_toMove, PieceType::King);
+  if (kingBB)
   {
-    int tmpVal = 0;
-    switch (piece.type)
+    king = lsb(kingBB);
+    // King is removed so it can not hide behind itself from sliding pieces
+    danger = this -> attackedSquares(them, occupied ^ kingBB);
+    pinned = this -> pinnedPieces(king);
+
+    // Double check means that only the king can move, single check can be also blocked or captured
+    Bitboard checkers = this -> attackersTo(king, them, occupied);
+    if (popCount(checkers) > 1)
+      checkMask = 0;
+    else if (checkers)
+      checkMask = checkers | Tables::BETWEEN[king][lsb(checkers)];
+
+    // Every way out of check is needed, even quiet one
+    if (checkers)
+      targetMask = B::BOARD_BB;
+  }
+  
+  // Iterate over all pieces and add their legal moves
+  Bitboard pieces = own;
+  while (pieces)
+  {
+    Square from = popLsb(pieces);
+    Bitboard targets = 0;
+    switch (m_board[from].type)
     {
-      case PieceType::Pawn:
-        tmpVal += 1;
+      case PieceType::King:
+        targets = Tables::KING[from] & ~own & ~danger;
         break;
-        
-      case PieceType::Knight:
-        tmpVal += 3;
+
+      case PieceType::Queen:
+        targets = Tables::queen(from, occupied) & ~own;
         break;
-        
+      
+      case PieceType::Rook:
+        targets = Tables::rook(from, occupied) & ~own;
+        break;
+
       case PieceType::Bishop:
-        tmpVal += 3;
+        targets = Tables::bishop(from, occupied) & ~own;
         break;
 
-      case PieceType::Rook:
-        tmpVal += 5;
+      case PieceType::Knight:
+        targets = Tables::KNIGHT[from] & ~own;
         break;
 
-       case PieceType::Queen:
-        tmpVal += 9;
+      case PieceType::Pawn:
+      {
+        // Pushes to empty squares, two squares from the starting row
+        if (m_toMove == Color::White)
+        {
+          targets = (squareBB(from) << Width) & B::BOARD_BB & ~occupied;
+          if (B::rankOf(from) == 1)
+            targets |= (targets << Width) & B::BOARD_BB & ~occupied;
+        }
+        else
+        {
+          targets = (squareBB(from) >> Width) & ~occupied;
+          if (B::rankOf(from) == Height - 2)
+            targets |= (targets >> Width) & ~occupied;
+        }
+
+        // Diagonal captures
+        targets |= Tables::PAWN[static_cast<int>(m_toMove)][from] & enemy;
         break;
-          
-       case PieceType::King:
-        tmpVal += 0;
+      }
+
+      default:
         break;
     }
-     
-    if (piece.color == Color::White)
-      value += tmpVal;
-    else
-      value -= tmpVal;
+
+    targets &= targetMask;
+
+    // Other pieces have to deal with check, pinned pieces can only move along the pin
+    if (m_board[from].type != PieceType::King)
+    {
+      targets &= checkMask;
+      if (pinned & squareBB(from))
+        targets &= Tables::LINE[king][from];
+    }
+
+    // Captures are flagged, double pawn push is not needed while there is no en passant
+    while (targets)
+    {
+      Square to = popLsb(targets);
+      moves.push(Move(from, to, (enemy & squareBB(to)) ? MoveFlag::Capture : MoveFlag::Quiet));
+    }
+  }
+  return moves;
+}
+
+/** Returns material won by the capture (in PIECE_VALUES) when both players keep recapturing on the target square
+    with their least valuable piece and stop when it does not pay off (static exchange evaluation, pins are ignored) */
+template <int Width, int Height>
+int Chess<Width, Height>::staticExchange(Move move) const
+{
+  // King is worth more than everything else, so capturing into defended square with it never pays off
+  constexpr std::array<int, 7> values = {100 * PIECE_VALUES[1], PIECE_VALUES[1], PIECE_VALUES[2], PIECE_VALUES[3], PIECE_VALUES[4], PIECE_VALUES[5], 0};
+
+  Square to = move.to();
+  Bitboard occupied = this -> occupied();
+  Bitboard straight = m_typeBB[static_cast<int>(PieceType::Rook)] | m_typeBB[static_cast<int>(PieceType::Queen)];
+  Bitboard diagonal = m_typeBB[static_cast<int>(PieceType::Bishop)] | m_typeBB[static_cast<int>(PieceType::Queen)];
+  Bitboard attackers = this -> attackersTo(to, Color::White, occupied) | this -> attackersTo(to, Color::Black, occupied);
+
+  // gains[i] is what the player making i-th capture wins if the exchange stopped after it
+  std::array<int, MAX_SQUARES + 1> gains;
+  int depth = 0;
+  gains[0] = values[static_cast<int>(m_board[to].type)];
+
+  Bitboard fromBB = squareBB(move.from());
+  PieceType attacker = m_board[move.from()].type;
+  Color side = m_board[move.from()].color;
+  while (true)
+  {
+    depth ++;
+    // What the other player wins by taking the piece that just captured
+    gains[depth] = values[static_cast<int>(attacker)] - gains[depth - 1];
+
+    // Sliding pieces behind the capturing piece join the exchange
+    occupied ^= fromBB;
+    attackers &= occupied;
+    attackers |= ((Tables::rook(to, occupied) & straight) | (Tables::bishop(to, occupied) & diagonal)) & occupied;
+
+    // Least valuable attacker of the other player recaptures
+    side = opposite(side);
+    Bitboard own = attackers & m_colorBB[static_cast<int>(side)];
+    if (!own)
+      break;
+
+    for (int type = static_cast<int>(PieceType::Pawn); type >= static_cast<int>(PieceType::King); type --)
+    {
+      Bitboard candidates = own & m_typeBB[type];
+      if (candidates)
+      {
+        fromBB = squareBB(lsb(candidates));
+        attacker = static_cast<PieceType>(type);
+        break;
+      }
+    }
+  }
+
+  // Each player either recaptures or stops, whatever is better
+  while (-- depth)
+    gains[depth - 1] = -std::max(-gains[depth - 1], gains[depth]);
+  return gains[0];
+}
+
+/** Returns legal move from pos1 to pos2 (no move if there is none) */
+template <int Width, int Height>
+Move Chess<Width, Height>::findMove(Position pos1, Position pos2) const
+{
+  if (!B::isOnBoard(pos1) || !B::isOnBoard(pos2))
+    return Move();
+
+  Square from = B::toSquare(pos1);
+  Square to = B::toSquare(pos2);
+  for (Move move: this -> findMoves())
+  {
+    if (move.from() == from && move.to() == to)
+      return move;
   }
+  return Move();
+}
+
+/** Checks if move is valid (legal) */
+template <int Width, int Height>
+bool Chess<Width, Height>::isValidMove(Position pos1, Position pos2) const
+{
+  return static_cast<bool>(this -> findMove(pos1, pos2));
+}
+
+/** Makes legal move (not checked) */
+template <int Width, int Height>
+void Chess<Width, Height>::makeMove(Move move)
+{
+  Square from = move.from();
+  Square to = move.to();
+  Piece piece = m_board[from];
   
-  return value;
+  // Type is Empty if there is no piece
+  Piece capturedPiece = m_board[to];
+
+  if (capturedPiece.type != PieceType::Empty)
+    this -> removePiece(to);
+
+  this -> removePiece(from);
+  this -> putPiece(to, piece);
+
+  // Change whose turn it is
+  m_toMove = opposite(m_toMove);
+  m_hash ^= ZOBRIST<SQUARE_COUNT>.blackToMove;
+  
+  // Save move to the log
+  m_moveLog.push_back({move, capturedPiece});
+
+  if (m_refreshAccumulator[0] || m_refreshAccumulator[1])
+    this -> refreshAccumulators();
+}
+
+/** Makes move: Pos1 (from), Pos2 (to), returns false if the move is not legal */
+template <int Width, int Height>
+bool Chess<Width, Height>::makeMove(Position pos1, Position pos2)
+{
+  Move move = this -> findMove(pos1, pos2);
+  if (!move)
+    return false;
+
+  this -> makeMove(move);
+  return true;
+}
+
+/** Undo the last move */
+template <int Width, int Height>
+void Chess<Width, Height>::undo()
+{
+  UndoRecord record = m_moveLog.back();
+  m_moveLog.pop_back();
+
+  Square to = record.move.to();
+  Piece piece = m_board[to];
+
+  this -> removePiece(to);
+  this -> putPiece(record.move.from(), piece);
+
+  // If captured piece was no empty
+  if (record.capturedPiece.type != PieceType::Empty)
+    this -> putPiece(to, record.capturedPiece);
+  
+  // Revert whose turn it is
+  m_toMove = opposite(m_toMove);
+  m_hash ^= ZOBRIST<SQUARE_COUNT>.blackToMove;
+
+  if (m_refreshAccumulator[0] || m_refreshAccumulator[1])
+    this -> refreshAccumulators();
+}
+
+/** Returns color of player that is about to move */
+template <int Width, int Height>
+Color Chess<Width, Height>::toMove() const
+{
+  return m_toMove;
 }
 
+#define INSTANTIATE_CHESS(width, height) template class Chess<width, height>;
+FOR_EACH_BOARD_SIZE(INSTANTIATE_CHESS)
@@ -7,33 +7,30 @@
 
 #pragma once
 
+#include "bitboard.hpp"
+#include "attacks.hpp"
+#include "zobrist.hpp"
+#include "pieceSquareTables.hpp"
+#include "nnue.hpp"
+#include "move.hpp"
+
 #include <utility>
 #include <cstddef> 
+#include <cstdint>
 #include <map>
+#include <span>
 #include <vector>
 #include <array>
-#include <stack>
-
-// Position on chess board
-using Position = std::pair<int, int>;
-
-#define BOARD_SIZE 5
+#include <string>
+#include <string_view>
 
-constexpr std::array<Position, 8> KING_MOVES = {{
-  {-1,1}, {0,1}, {1,1}, {1,0}, {1,-1}, {0,-1}, {-1,-1}, {-1,0}
-}};
-
-constexpr std::array<Position, 4> ROOK_MOVES = {{
-  {1,0}, {-1,0}, {0,1}, {0,-1}
-}};
-
-enum class Color
+enum class Color : std::uint8_t
 {
   White, 
   Black
 };
 
-enum class PieceType
+enum class PieceType : std::uint8_t
 {
   King,
   Queen,
@@ -46,95 +43,297 @@ enum class PieceType
 
 struct Piece
 {
-  Color color;
-  PieceType type;
+  Color color = Color::White;
+  PieceType type = PieceType::Empty;
 };
 
-struct Move
+// Piece values in centipawns indexed by PieceType
+constexpr std::array<int, 6> PIECE_VALUES = {0, 900, 500, 300, 300, 100};
+
+// Pieces of the first row of the default setup indexed by board width
+constexpr std::array<std::string_view, MAX_BOARD_SIZE + 1> BACK_RANKS = {
+  "", "K", "KR", "RKR", "RQKR", "RNBQK", "RNQKNR", "RNBQKNR", "RNBQKBNR"
+};
+
+/** Returns game phase of the default setup on board of given width (both players), it goes down to 0 as pieces are traded */
+constexpr int startingPhase(int width)
 {
-  Position from;
-  Position to;
-  Piece movedPiece;
+  int phase = 0;
+  for (char letter: BACK_RANKS[width])
+    phase += 2 * PHASE_WEIGHTS[std::string_view("KQRBNP").find(letter)];
+  return phase;
+}
+
+/** Returns the other color */
+constexpr Color opposite(Color color)
+{
+  return color == Color::White ? Color::Black : Color::White;
+}
+
+/** Returns name of position in algebraic notation (a1 is bottom left corner) */
+std::string positionToString(Position pos);
+
+/** Returns move in coordinate notation (e.g. a1a3) */
+std::string moveToString(const std::pair<Position, Position> & move);
+
+/** Finds board size of FEN (number of files and ranks), returns false if the ranks differ in length */
+bool fenBoardSize(const std::string & fen, int & width, int & height);
+
+// What undo needs to restore the position, moved piece is found on the target square
+struct UndoRecord
+{
+  Move move;
   Piece capturedPiece;
-  bool wasFirstMove;
 };
 
 /* White player is the botom player in this representation, position (0,0) represents bottom left corner of the board */
 /* First coordinate represents X Axis, second coordinate represents Y Axis */
+/* Board size is a template parameter, so every size gets its own code with constant loop bounds and tables */
 
+template <int Width, int Height>
 class Chess
 {
   public:
+    using B = Board<Width, Height>;
+    static constexpr int SQUARE_COUNT = B::SQUARE_COUNT;
     
-    /** Constructor  white is botton player, black is bottom player */
+    /** Constructor  white is botton player, black is bottom player (simple setup on 5x5 board, default setup otherwise) */
     Chess();
+
+    /** Constructor from given pieces, pieces outside of the board are ignored */
+    Chess(const std::map<Position, Piece> & pieces, Color toMove = Color::White);
+
+    /** Constructor from pieces on given squares (fast, squares have to be on the board and different) */
+    Chess(std::span<const std::pair<Square, Piece>> pieces, Color toMove);
     
-    /** Sets up default position for white player being at bottom */
+    /** Sets up default position for white player being at bottom (back rank depends on board width) */
     static std::map<Position, Piece> setup(void);
     
-    /** Simple board setup (for showcase and testing */
+    /** Simple board setup (for showcase and testing, made for 5x5 board) */
     static std::map<Position, Piece> simpleSetup1(void);
 
-    /** Simple board setup (for showcase and testing */
+    /** Simple board setup (for showcase and testing, made for 5x5 board) */
     static std::map<Position, Piece> simpleSetup2(void);
 
-    /** Simple board setup (for showcase and testing */
+    /** Simple board setup (for showcase and testing, made for 5x5 board) */
     static std::map<Position, Piece> simpleSetup3(void);
 
-    /** Returns current state of board */
-    std::map<Position, Piece> getBoard(void) {return m_pieces;};
-    
-    /** Check if the move does not put your own king at check */
-    bool isCheck(Position pos1, Position pos2);
-    
-    /** Check if the move checks other king */
-    bool isChecking();
+    /** Loads position from FEN with Height ranks (only pieces and side to move are used), returns false if FEN is invalid */
+    bool loadFen(const std::string & fen);
+
+    /** Returns position as FEN (pieces and side to move) */
+    std::string fen(void) const;
+
+    /** Returns current state of board (slow, builds the map from bitboards - meant for visualisation only) */
+    std::map<Position, Piece> getBoard(void) const;
 
-    /** Find all moves for current colour */
-    std::vector<std::pair<Position, Position>> findMoves();
+    /** Returns piece at given position (type is Empty if there is none) */
+    Piece pieceAt(Position pos) const
+    {
+      return m_board[B::toSquare(pos)];
+    }
+
+    /** Returns piece on given square (type is Empty if there is none) */
+    Piece pieceAt(Square sq) const
+    {
+      return m_board[sq];
+    }
+
+    /** Returns move in coordinate notation (e.g. a1a3) */
+    static std::string moveToString(Move move)
+    {
+      return positionToString(B::toPosition(move.from())) + positionToString(B::toPosition(move.to()));
+    }
     
-    /** Validates move for pawn */
-    static bool isValidPawnMove(std::map<Position, Piece> & pieces, Position pos1, Position pos2);
-  
-    /** Validates move for king */
-    static bool isValidKingMove(std::map<Position, Piece> & pieces, Position pos1, Position pos2);
-  
-    /** Validates move for Rook */
-    static bool isValidRookMove(std::map<Position, Piece> & pieces, Position pos1, Position pos2);
-
-    /** Checks if move is valid */
-    bool isValidMove(Position pos1, Position pos2);
-
-    /** Makes move: Pos1 (from), Pos2 (to) */
+    /** Check if the king of player to move is in check */
+    bool isChecking() const;
+
+    /** Check if the king of given color is in check */
+    bool isInCheck(Color color) const;
+
+    /** Find all legal moves for current colour */
+    MoveList findMoves() const;
+
+    /** Find legal captures for current colour, all legal moves if the king is in check (quiescence search) */
+    MoveList findCaptures() const;
+
+    /** Returns material won by the capture (in PIECE_VALUES) when both players keep recapturing on the target square
+        with their least valuable piece and stop when it does not pay off (static exchange evaluation, pins are ignored) */
+    int staticExchange(Move move) const;
+
+    /** Returns legal move from pos1 to pos2 (no move if there is none) */
+    Move findMove(Position pos1, Position pos2) const;
+
+    /** Checks if move is valid (legal) */
+    bool isValidMove(Position pos1, Position pos2) const;
+
+    /** Makes legal move (not checked) */
+    void makeMove(Move move);
+
+    /** Makes move: Pos1 (from), Pos2 (to), returns false if the move is not legal */
     bool makeMove(Position pos1, Position pos2);
     
     /** Returns color of player that is about to move */
-    Color toMove(void);
+    Color toMove(void) const;
 
-    /** Returns value (1 = white, 0 = black player */
-    size_t evaluate(Color color);
-    
-    /** Returns white - black evaluation */
-    int fastEval();
+    /** Returns Zobrist hash of the position (updated incrementally by makeMove and undo) */
+    std::uint64_t hash(void) const
+    {
+      return m_hash;
+    }
+
+    /** Returns white - black evaluation in centipawns. Material, piece-square tables and game phase are kept up to date
+        by makeMove and undo, mobility and king attacks are scored by the evaluation kernel */
+    int fastEval() const;
+
+    /** Returns white - black evaluation without mobility and king attacks, much cheaper than fastEval */
+    int incrementalEval() const;
+
+    /** Evaluates with the network from now on (nullptr goes back to fastEval), accumulators are computed from scratch.
+        The network has to outlive the game and all its copies */
+    void setNetwork(const Network * network);
+
+    /** Returns true if the game is evaluated by a network */
+    bool hasNetwork(void) const
+    {
+      return m_network != nullptr;
+    }
+
+    /** Returns white - black evaluation of the network in centipawns (has to be set). Accumulators are kept up to date by
+        makeMove and undo, so only the output layer runs */
+    int networkEval() const;
     
     /** Undo the last move */
     void undo(void);
 
+    /** Passes the turn without moving (null move pruning), has to be taken back by undoNullMove before any undo */
+    void makeNullMove(void)
+    {
+      m_toMove = opposite(m_toMove);
+      m_hash ^= ZOBRIST<SQUARE_COUNT>.blackToMove;
+    }
+
+    /** Takes back the null move */
+    void undoNullMove(void)
+    {
+      this -> makeNullMove();
+    }
+
     /** Returns last move */
-    Move lastMove(void)
+    Move lastMove(void) const
+    {
+      return m_moveLog.back().move;
+    }
+
+    /** Returns bitboard of given pieces */
+    Bitboard pieces(Color color, PieceType type) const
     {
-      return m_moveLog.top();
+      return m_colorBB[static_cast<int>(color)] & m_typeBB[static_cast<int>(type)];
+    }
+
+    /** Returns bitboard of all pieces on the board */
+    Bitboard occupied(void) const
+    {
+      return m_colorBB[0] | m_colorBB[1];
     }
 
   private:
+    using Tables = Attacks<Width, Height>;
+
+    /** Places piece on empty square */
+    void putPiece(Square sq, Piece piece)
+    {
+      int color = static_cast<int>(piece.color);
+      int type = static_cast<int>(piece.type);
+      m_board[sq] = piece;
+      m_colorBB[color] |= squareBB(sq);
+      m_typeBB[type] |= squareBB(sq);
+      m_hash ^= ZOBRIST<SQUARE_COUNT>.pieces[color][type][sq];
+      m_material[color] += PIECE_VALUES[type];
+      m_positional[color] += PIECE_SQUARE<Width, Height>[color][type][sq];
+      m_phase += PHASE_WEIGHTS[type];
+      if (m_network)
+        this -> updateAccumulators(sq, piece, true);
+    }
+
+    /** Removes piece from occupied square */
+    void removePiece(Square sq)
+    {
+      Piece piece = m_board[sq];
+      int color = static_cast<int>(piece.color);
+      int type = static_cast<int>(piece.type);
+      m_colorBB[color] &= ~squareBB(sq);
+      m_typeBB[type] &= ~squareBB(sq);
+      m_hash ^= ZOBRIST<SQUARE_COUNT>.pieces[color][type][sq];
+      m_material[color] -= PIECE_VALUES[type];
+      m_positional[color] -= PIECE_SQUARE<Width, Height>[color][type][sq];
+      m_phase -= PHASE_WEIGHTS[type];
+      if (m_network)
+        this -> updateAccumulators(sq, piece, false);
+      m_board[sq] = Piece();
+    }
+
+    /** Returns pieces of given color attacking the square */
+    Bitboard attackersTo(Square sq, Color by, Bitboard occupied) const;
+
+    /** Returns all squares attacked by pieces of given color */
+    Bitboard attackedSquares(Color by, Bitboard occupied) const;
+
+    /** Returns pieces of player to move pinned to its king */
+    Bitboard pinnedPieces(Square king) const;
+
+    /** Returns network feature of piece on square seen by given player with king on given square */
+    static size_t networkFeature(Color perspective, Square king, Piece piece, Square sq);
+
+    /** Adds or removes feature of the piece in accumulators of both players. Moving king changes all features of its
+        player, so its accumulator is only marked to be computed again after the move */
+    void updateAccumulators(Square sq, Piece piece, bool add);
+
+    /** Computes marked accumulators from scratch */
+    void refreshAccumulators(void);
+
+    /** Mixes middlegame and endgame score by the game phase */
+    int taper(const TaperedScore & score) const;
+
+    /** Returns mobility and king attack score of all pieces except kings and pawns (white - black) */
+    TaperedScore pieceActivity(void) const;
+
+    /** Generates legal moves, only captures (or check evasions) if CapturesOnly is set */
+    template <bool CapturesOnly>
+    MoveList generateMoves() const;
     
-    // Current state of the board                                                                                             
-    std::map<Position, Piece> m_pieces;
+    // Occupancy of each color, indexed by Color
+    std::array<Bitboard, 2> m_colorBB = {};
+
+    // Occupancy of each piece type, indexed by PieceType
+    std::array<Bitboard, 6> m_typeBB = {};
+
+    // Piece on each square (type is Empty if there is none)
+    std::array<Piece, SQUARE_COUNT> m_board = {};
     
-    std::stack<Move> m_moveLog;
+    // Played moves, the vector keeps its capacity so moves made during search do not allocate
+    std::vector<UndoRecord> m_moveLog;
 
     // Who is to move
     Color m_toMove;
+
+    // Zobrist hash of the position
+    std::uint64_t m_hash = 0;
+
+    // Evaluation terms of each color, updated with every piece put on or removed from the board
+    std::array<int, 2> m_material = {};
+    std::array<TaperedScore, 2> m_positional = {};
+
+    // Game phase of the default setup, positions with more material are evaluated as middlegame
+    static constexpr int MAX_PHASE = startingPhase(Width);
+
+    // Sum of PHASE_WEIGHTS of all pieces on the board
+    int m_phase = 0;
+
+    // Evaluation network (not owned) and its hidden layer of each player, indexed by Color
+    const Network * m_network = nullptr;
+    std::array<Accumulator, 2> m_accumulators;
+    std::array<bool, 2> m_refreshAccumulator = {};
 };
 
 
@@ -6,91 +6,840 @@
 */
  
 #include "engine.hpp"
-#include <climits>
-#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
 
-/** Find the best move for current chess game*/
-std::pair<Position, Position> Engine::findBestMove(Chess game, int depth)
+// Move ordering scores, quiet moves are ordered by history values below HISTORY_MAX
+constexpr int HASH_MOVE_SCORE = 1000000;
+constexpr int CAPTURE_SCORE = 500000;
+constexpr int KILLER_SCORE = 400000;
+constexpr int HISTORY_MAX = 100000;
+
+// Aspiration window starts this far (in centipawns) from the score of previous depth and doubles whenever the score falls
+// outside of it, first depth searched with the window
+constexpr int ASPIRATION_WINDOW = 100;
+constexpr int ASPIRATION_DEPTH = 4;
+
+// Null move is searched this much shallower (one more every NULL_MOVE_DEPTH_STEP plies of depth)
+constexpr int NULL_MOVE_MIN_DEPTH = 3;
+constexpr int NULL_MOVE_REDUCTION = 2;
+constexpr int NULL_MOVE_DEPTH_STEP = 6;
+
+// Moves searched at full depth before the late ones get reduced
+constexpr int LMR_MIN_DEPTH = 3;
+constexpr size_t LMR_FULL_DEPTH_MOVES = 3;
+
+// Futility margin in centipawns indexed by remaining depth
+constexpr std::array<int, 3> FUTILITY_MARGIN = {0, 200, 400};
+
+// Reverse futility margin in centipawns per ply of remaining depth
+constexpr int REVERSE_FUTILITY_MAX_DEPTH = 3;
+constexpr int REVERSE_FUTILITY_MARGIN = 200;
+
+// Mobility and king attacks rarely change the evaluation by more than this, positions whose incremental evaluation is
+// this far outside of the window are not worth scoring the pieces
+constexpr int LAZY_EVAL_MARGIN = 150;
+
+/** Returns static evaluation from the view of the player to move */
+template <typename Game>
+static int evaluate(const Game & game)
 {
-  std::vector<std::pair<Position, Position>> moves = game.findMoves();
-  std::cout << "All moves:" << std::endl;
-  for (const auto & [first, second]: moves)
-    std::cout << first.first << " " << first.second << std::endl;
+  int eval = game.hasNetwork() ? game.networkEval() : game.fastEval();
+  return (game.toMove() == Color::White) ? eval : -eval;
+}
 
-  // returns {{-1,-1},{-1,-1}} if no move can be made
-  if (moves.empty())
-    return {{-1, -1}, {-1,-1}};
-  
+/** Returns static evaluation from the view of the player to move, only the incremental part if it is far outside of
+    the window (network is always run, it costs about as much as the incremental part) */
+template <typename Game>
+static int lazyEvaluate(const Game & game, int alpha, int beta)
+{
+  if (game.hasNetwork())
+    return evaluate(game);
+
+  int eval = game.incrementalEval();
+  eval = (game.toMove() == Color::White) ? eval : -eval;
+  if (eval - LAZY_EVAL_MARGIN >= beta || eval + LAZY_EVAL_MARGIN <= alpha)
+    return eval;
+  return evaluate(game);
+}
+
+/** Returns true if player has other pieces than king and pawns (positions with only pawns are often zugzwang) */
+template <typename Game>
+static bool hasPieces(const Game & game, Color color)
+{
+  return game.pieces(color, PieceType::Queen) | game.pieces(color, PieceType::Rook) |
+         game.pieces(color, PieceType::Bishop) | game.pieces(color, PieceType::Knight);
+}
+
+/** Returns score of solved endgame from the view of the player to move, mate distance is relative to the root */
+static int tablebaseScore(const TablebaseResult & solved, int ply)
+{
+  if (solved.wdl == Wdl::Draw)
+    return 0;
+  int score = MATE_SCORE - ply - solved.distance;
+  return (solved.wdl == Wdl::Win) ? score : -score;
+}
+
+/** Mate scores are stored relative to the position, not to the root */
+static int scoreToTable(int score, int ply)
+{
+  if (score > MATE_BOUND)
+    return score + ply;
+  if (score < -MATE_BOUND)
+    return score - ply;
+  return score;
+}
+
+/** Converts score from the table back to be relative to the root */
+static int scoreFromTable(int score, int ply)
+{
+  if (score > MATE_BOUND)
+    return score - ply;
+  if (score < -MATE_BOUND)
+    return score + ply;
+  return score;
+}
+
+/** Constructor, size of transposition table in megabytes */
+template <int Width, int Height>
+Engine<Width, Height>::Engine(size_t hashMegabytes)
+  : m_table(hashMegabytes), m_tablebases(Width, Height)
+{
+  this -> startThreads();
+}
+
+/** Stops the search and ends the search threads */
+template <int Width, int Height>
+Engine<Width, Height>::~Engine()
+{
+  this -> stopThreads();
+}
+
+/** Changes size of transposition table in megabytes (clears it) */
+template <int Width, int Height>
+void Engine<Width, Height>::setHashSize(size_t megabytes)
+{
+  m_table.resize(megabytes);
+}
+
+/** Forgets everything learned from previous searches (new game) */
+template <int Width, int Height>
+void Engine<Width, Height>::clearHash(void)
+{
+  m_table.clear();
+}
+
+/** Sets number of threads used by the search (restarts the search threads). Must not be called during search */
+template <int Width, int Height>
+void Engine<Width, Height>::setThreads(int threads)
+{
+  threads = std::max(threads, 1);
+  if (threads == m_threads)
+    return;
+
+  this -> stopThreads();
+  m_threads = threads;
+  this -> startThreads();
+}
+
+/** Loads endgame tablebases (*.tb) from directory, returns number of loaded tables. Must not be called during search */
+template <int Width, int Height>
+size_t Engine<Width, Height>::loadTablebases(const std::string & directory)
+{
+  return m_tablebases.load(directory);
+}
+
+/** Loads evaluation network used instead of the handcrafted evaluation, returns false if the file is not a network
+    of this board size (the previous one is kept). Must not be called during search */
+template <int Width, int Height>
+bool Engine<Width, Height>::loadNetwork(const std::string & filename)
+{
+  auto network = std::make_unique<Network>();
+  if (!network -> load(filename, Width, Height))
+    return false;
+  m_network = std::move(network);
+  return true;
+}
+
+/** Returns number of positions searched by all threads */
+template <int Width, int Height>
+std::uint64_t Engine<Width, Height>::nodes(void) const
+{
+  std::uint64_t nodes = 0;
+  for (const auto & worker: m_workers)
+    nodes += worker -> nodes.load(std::memory_order_relaxed);
+  return nodes;
+}
+
+/** Find the best move for current chess game, searching to fixed depth */
+template <int Width, int Height>
+SearchResult Engine<Width, Height>::findBestMove(Game game, int depth)
+{
+  SearchLimits limits;
+  limits.depth = depth;
+  return this -> findBestMove(game, limits);
+}
+
+/** Find the best move for current chess game, searching deeper until one of the limits runs out */
+template <int Width, int Height>
+SearchResult Engine<Width, Height>::findBestMove(Game game, const SearchLimits & limits)
+{
+  SearchResult result;
+  this -> startSearch(game, limits, [&result](const SearchResult & found) {result = found;});
+  this -> wait();
+  return result;
+}
+
+/** Starts searching in the background and returns at once, search that is running is stopped first. The search
+    thread calls onFinished with the result when the search ends (limits ran out or stop was called) */
+template <int Width, int Height>
+void Engine<Width, Height>::startSearch(Game game, const SearchLimits & limits, std::function<void(const SearchResult &)> onFinished)
+{
+  this -> stop();
+  this -> wait();
+
+  MoveList moves = game.findMoves();
+  m_workers.clear();
+  m_trivialResult = SearchResult();
+
+  // Nothing to think about if there is one move or none, threads only report the result
+  if (moves.size() == 1)
+    m_trivialResult.move = moves[0];
 
-  Color player = game.toMove();
-  int bestScore = (player == Color::White) ? INT_MIN : INT_MAX;
-  std::pair<Position, Position> bestMove = moves[0]; // default move
+  if (moves.size() > 1)
+  {
+    // Copies of the game made for the threads keep the accumulators
+    game.setNetwork(m_network.get());
+    m_table.newSearch();
+    for (int id = 0; id < m_threads; id ++)
+      m_workers.push_back(std::make_unique<Worker>(id, game, moves));
+  }
+
+  m_root = game;
+  m_limits = limits;
+  m_onFinished = std::move(onFinished);
+  m_startTime = std::chrono::steady_clock::now();
+  m_pondering = limits.ponder;
+  m_stop = false;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_searching = true;
+    m_runningHelpers = m_threads - 1;
+    m_searchId ++;
+  }
+  m_wakeUp.notify_all();
+}
+
+/** Waits until the running search ends and its onFinished returns (must not be called from the callbacks) */
+template <int Width, int Height>
+void Engine<Width, Height>::wait(void)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_finished.wait(lock, [this]() {return !m_searching;});
+}
+
+/** Returns true from startSearch until onFinished of the search returns */
+template <int Width, int Height>
+bool Engine<Width, Height>::isSearching(void)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_searching;
+}
+
+/** Starts the search threads, they sleep in threadLoop until a search starts */
+template <int Width, int Height>
+void Engine<Width, Height>::startThreads(void)
+{
+  m_quit = false;
+  for (int id = 0; id < m_threads; id ++)
+    m_pool.emplace_back([this, id, searchId = m_searchId]() {this -> threadLoop(id, searchId);});
+}
+
+/** Stops the search and ends the search threads */
+template <int Width, int Height>
+void Engine<Width, Height>::stopThreads(void)
+{
+  this -> stop();
+  this -> wait();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wakeUp.notify_all();
+  for (auto & thread: m_pool)
+    thread.join();
+  m_pool.clear();
+}
+
+/** Body of search thread with given id, runs every started search until the engine quits */
+template <int Width, int Height>
+void Engine<Width, Height>::threadLoop(int id, std::uint64_t searchId)
+{
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeUp.wait(lock, [this, searchId]() {return m_quit || m_searchId != searchId;});
+      if (m_quit)
+        return;
+      searchId = m_searchId;
+    }
+
+    if (id == 0)
+    {
+      this -> searchMain();
+      continue;
+    }
+
+    // Helper threads only fill the transposition table, the move is decided by the main thread
+    if (id < static_cast<int>(m_workers.size()))
+      this -> iterativeDeepening(*m_workers[id]);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_runningHelpers --;
+    }
+    m_finished.notify_all();
+  }
+}
+
+/** Runs the search of the main thread, waits for the helpers and reports the result */
+template <int Width, int Height>
+void Engine<Width, Height>::searchMain(void)
+{
+  if (!m_workers.empty())
+    this -> iterativeDeepening(*m_workers[0]);
+
+  // Ponder search reports its result only after ponderHit or stop and infinite search only after stop, even if they
+  // ended early (forced mate, full depth, single legal move)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_ponderEnd.wait(lock, [this]() {return (!m_pondering && !m_limits.infinite) || m_stop;});
+  }
+
+  m_stop = true;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this]() {return m_runningHelpers == 0;});
+  }
+
+  SearchResult result = m_workers.empty() ? m_trivialResult : this -> collectResult();
+  auto onFinished = std::move(m_onFinished);
+  m_onFinished = nullptr;
+  if (onFinished)
+    onFinished(result);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_searching = false;
+  }
+  m_finished.notify_all();
+}
+
+/** Returns best move of the finished search with statistics summed over all threads */
+template <int Width, int Height>
+SearchResult Engine<Width, Height>::collectResult(void) const
+{
+  SearchResult result;
+  const Worker & main = *m_workers[0];
+  result.move = main.bestMove;
+  result.score = (m_root.toMove() == Color::White) ? main.bestScore : -main.bestScore;
+  std::vector<Move> pv = this -> principalVariation(m_root, main.bestMove, 2);
+  if (pv.size() > 1)
+    result.ponderMove = pv[1];
+  result.stats = main.stats;
+  result.stats.leafNodes = result.stats.quiescenceNodes = result.stats.betaCutoffs = result.stats.firstMoveCutoffs = 0;
+  result.stats.ttHits = result.stats.tablebaseHits = 0;
+  result.stats.nullMoveCutoffs = result.stats.reverseFutilityCutoffs = result.stats.futilityPrunes = 0;
+  result.stats.reductions = result.stats.reResearches = 0;
+  for (const auto & worker: m_workers)
+  {
+    result.stats.nullMoveCutoffs += worker -> stats.nullMoveCutoffs;
+    result.stats.reverseFutilityCutoffs += worker -> stats.reverseFutilityCutoffs;
+    result.stats.futilityPrunes += worker -> stats.futilityPrunes;
+    result.stats.reductions += worker -> stats.reductions;
+    result.stats.reResearches += worker -> stats.reResearches;
+    result.stats.leafNodes += worker -> stats.leafNodes;
+    result.stats.quiescenceNodes += worker -> stats.quiescenceNodes;
+    result.stats.betaCutoffs += worker -> stats.betaCutoffs;
+    result.stats.firstMoveCutoffs += worker -> stats.firstMoveCutoffs;
+    result.stats.ttHits += worker -> stats.ttHits;
+    result.stats.tablebaseHits += worker -> stats.tablebaseHits;
+    result.stats.selectiveDepth = std::max(result.stats.selectiveDepth, worker -> stats.selectiveDepth);
+  }
+  result.stats.nodes = this -> nodes();
+  result.stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_startTime.load());
   
-  for (const auto & [from, to]: moves)
+  return result;
+}
+
+/** Searches deeper and deeper until stopped, result of the last finished depth is kept in the worker */
+template <int Width, int Height>
+void Engine<Width, Height>::iterativeDeepening(Worker & worker)
+{
+  // Every other helper starts one depth deeper, so the threads do not search the same depths at the same time
+  worker.bestMove = worker.rootMoves[0]; // default move
+  std::uint64_t previousNodes = 0;
+  for (int depth = 1 + worker.id % 2; depth <= m_limits.depth; depth ++)
+  {
+    std::uint64_t startNodes = worker.nodes.load(std::memory_order_relaxed);
+
+    // Score most likely stays close to the previous one, narrow window is searched faster. When the score falls
+    // outside, the window is widened on that side and the depth is searched again
+    int delta = ASPIRATION_WINDOW;
+    int alpha = -INFINITE_SCORE;
+    int beta = INFINITE_SCORE;
+    if (m_options.aspiration && depth >= ASPIRATION_DEPTH && std::abs(worker.bestScore) < MATE_BOUND)
+    {
+      alpha = worker.bestScore - delta;
+      beta = worker.bestScore + delta;
+    }
+
+    int score;
+    bool finished;
+    while (true)
+    {
+      // Result of unfinished depth is thrown away, each finished depth puts its best move first for the next one
+      finished = this -> searchRoot(worker, depth, alpha, beta, score);
+      if (!finished)
+        break;
+
+      if (score <= alpha && alpha > -INFINITE_SCORE)
+        alpha = std::max(score - delta, -INFINITE_SCORE);
+      else if (score >= beta && beta < INFINITE_SCORE)
+        beta = std::min(score + delta, INFINITE_SCORE);
+      else
+        break;
+      delta *= 2;
+    }
+    if (!finished)
+      break;
+
+    worker.bestMove = worker.rootMoves[0];
+    worker.bestScore = score;
+    worker.stats.depth = depth;
+
+    std::uint64_t depthNodes = worker.nodes.load(std::memory_order_relaxed) - startNodes;
+    if (previousNodes)
+      worker.stats.effectiveBranchingFactor = static_cast<double>(depthNodes) / previousNodes;
+    previousNodes = depthNodes;
+
+    if (worker.id != 0)
+      continue;
+
+    if (m_infoCallback)
+    {
+      SearchInfo info;
+      info.depth = depth;
+      info.selectiveDepth = worker.stats.selectiveDepth;
+      info.score = score;
+      info.nodes = this -> nodes();
+      info.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_startTime.load());
+      info.pv = this -> principalVariation(worker.game, worker.bestMove, depth);
+      m_infoCallback(info);
+    }
+
+    // Forced mate was found, searching deeper can not change it
+    if (std::abs(score) > MATE_BOUND)
+      break;
+
+    // Next depth takes longer than all the previous ones together, it would most likely not finish
+    if (!m_pondering && m_limits.time.count() && (std::chrono::steady_clock::now() - m_startTime.load()) * 2 > m_limits.time)
+      break;
+  }
+}
+
+/** Searches all moves at the root to given depth inside of the window, returns false if the search was stopped
+    before finishing. Best move is moved to the front */
+template <int Width, int Height>
+bool Engine<Width, Height>::searchRoot(Worker & worker, int depth, int alpha, int beta, int & bestScore)
+{
+  Game & game = worker.game;
+  MoveList & moves = worker.rootMoves;
+  bestScore = -INFINITE_SCORE;
+  size_t bestIndex = 0;
+
+  for (size_t i = 0; i < moves.size(); i ++)
   {
-    game.makeMove(from, to);
-    int score = minimax(game, depth -1, INT_MIN, INT_MAX, player == Color::Black);
+    game.makeMove(moves[i]);
+    int score;
+    if (i == 0 || !m_options.pvs)
+      score = -this -> negamax(worker, depth - 1, 1, -beta, -alpha, true);
+    else
+    {
+      // Move is most likely worse than the first one, null window only proves it
+      score = -this -> negamax(worker, depth - 1, 1, -alpha - 1, -alpha, true);
+      if (score > alpha && score < beta)
+        score = -this -> negamax(worker, depth - 1, 1, -beta, -alpha, true);
+    }
     game.undo();
 
-    if ((player == Color::White && score > bestScore) || 
-        (player == Color::Black && score < bestScore))
+    if (m_stop)
+      return false;
+
+    if (score > bestScore)
     {
       bestScore = score;
-      bestMove = {from, to};
+      bestIndex = i;
     }
+    alpha = std::max(alpha, score);
+
+    // Score is above aspiration window, the depth is searched again with wider one
+    if (alpha >= beta)
+      break;
   }
-  
-  return bestMove;
+
+  // Best move goes first, the rest keeps its order
+  std::rotate(moves.begin(), moves.begin() + bestIndex, moves.begin() + bestIndex + 1);
+  return true;
+}
+
+/** Returns principal variation starting with given move, the rest is followed through the transposition table */
+template <int Width, int Height>
+std::vector<Move> Engine<Width, Height>::principalVariation(Game game, Move first, int maxLength) const
+{
+  std::vector<Move> pv = {first};
+  game.makeMove(first);
+
+  // Entries can be overwritten by other positions, only legal moves are followed
+  TTEntry entry;
+  while (static_cast<int>(pv.size()) < maxLength && m_table.probe(game.hash(), entry) && entry.move)
+  {
+    Move move(entry.move);
+    MoveList moves = game.findMoves();
+    if (std::find(moves.begin(), moves.end(), move) == moves.end())
+      break;
+    pv.push_back(move);
+    game.makeMove(move);
+  }
+  return pv;
+}
+
+/** Checks if the search should stop, limits are checked by the main thread every few thousand positions */
+template <int Width, int Height>
+bool Engine<Width, Height>::shouldStop(const Worker & worker)
+{
+  if (m_stop.load(std::memory_order_relaxed))
+    return true;
+
+  if (worker.id != 0 || (worker.nodes.load(std::memory_order_relaxed) & 1023) != 0 || m_pondering)
+    return false;
+
+  if (m_limits.nodes && this -> nodes() >= m_limits.nodes)
+    return true;
+
+  if (m_limits.time.count() && std::chrono::steady_clock::now() - m_startTime.load() >= m_limits.time)
+    return true;
+
+  return false;
 }
  
-/** Minimax algorithm to find the best move */
-int Engine::minimax(Chess & game, int depth, int alpha, int beta, bool maximizingPlayer)
+/** Orders moves so the most promising ones are searched first */
+// Order is: best move from the transposition table, captures by most valuable victim and least valuable attacker,
+// killer moves and the rest of quiet moves by history
+template <int Width, int Height>
+void Engine<Width, Height>::orderMoves(const Worker & worker, MoveList & moves, Move hashMove, int ply) const
 {
-  std::vector<std::pair<Position, Position>> moves = game.findMoves();
-  if (depth == 0 || moves.empty())
+  const Game & game = worker.game;
+  const auto & history = worker.history[static_cast<int>(game.toMove())];
+  const auto & killers = worker.killers[std::min(ply, MAX_PLY - 1)];
+
+  std::array<int, MAX_MOVES> scores;
+  for (size_t i = 0; i < moves.size(); i ++)
   {
-    if (game.isChecking())
+    Move move = moves[i];
+    int score;
+    if (move == hashMove)
+      score = HASH_MOVE_SCORE;
+    // King is the least valuable attacker, it can only capture undefended pieces
+    else if (move.isCapture())
+      score = CAPTURE_SCORE + PIECE_VALUES[static_cast<int>(game.pieceAt(move.to()).type)] * 16
+            - PIECE_VALUES[static_cast<int>(game.pieceAt(move.from()).type)];
+    else if (move == killers[0])
+      score = KILLER_SCORE;
+    else if (move == killers[1])
+      score = KILLER_SCORE - 1;
+    else
+      score = history[move.from()][move.to()];
+
+    // Insertion sort, stable and fast for the few moves of one position
+    size_t j = i;
+    for (; j > 0 && scores[j - 1] < score; j --)
     {
-      return maximizingPlayer ? -10000 - depth : 10000 + depth;
+      scores[j] = scores[j - 1];
+      moves[j] = moves[j - 1];
     }
-    int res = game.fastEval();
-    return res;
+    scores[j] = score;
+    moves[j] = move;
+  }
+}
+
+/** Counts beta cutoff and remembers quiet move that caused it as killer move and in history table */
+template <int Width, int Height>
+void Engine<Width, Height>::updateCutoff(Worker & worker, Move move, int depth, int ply, bool firstMove)
+{
+  worker.stats.betaCutoffs ++;
+  if (firstMove)
+    worker.stats.firstMoveCutoffs ++;
+
+  if (move.isCapture())
+    return;
+
+  auto & killers = worker.killers[std::min(ply, MAX_PLY - 1)];
+  if (killers[0] != move)
+  {
+    killers[1] = killers[0];
+    killers[0] = move;
+  }
+
+  // Deeper cutoffs are worth more, all values are halved when they grow too big so they stay below killers
+  auto & history = worker.history[static_cast<int>(worker.game.toMove())];
+  int & value = history[move.from()][move.to()];
+  value += depth * depth;
+  if (value > HISTORY_MAX)
+  {
+    for (auto & from: history)
+      for (auto & to: from)
+        to /= 2;
+  }
+}
+
+/** Negamax principal variation search, returns score from the view of the player to move. Ply is distance from
+    the root, null move is not allowed twice in a row */
+template <int Width, int Height>
+int Engine<Width, Height>::negamax(Worker & worker, int depth, int ply, int alpha, int beta, bool allowNullMove)
+{
+  // Captures are resolved before the position is evaluated
+  if (depth <= 0)
+    return this -> quiescence(worker, ply, alpha, beta);
+
+  // Only this thread writes its counter
+  worker.nodes.store(worker.nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if (this -> shouldStop(worker))
+  {
+    m_stop = true;
+    return 0;
+  }
+
+  Game & game = worker.game;
+
+  // Endgame is solved
+  TablebaseResult solved;
+  if (m_tablebases.probe(game, solved))
+  {
+    worker.stats.tablebaseHits ++;
+    return tablebaseScore(solved, ply);
   }
 
-  if (maximizingPlayer)
+  // Position could have been already searched through different move order
+  std::uint64_t key = game.hash();
+  Move hashMove = Move();
+  TTEntry entry;
+  if (m_table.probe(key, entry))
   {
-    int maxEval = INT_MIN;
-    for (const auto & [from, to]: moves)
+    worker.stats.ttHits ++;
+    hashMove = Move(entry.move);
+    int score = scoreFromTable(entry.score, ply);
+    if (entry.depth >= depth && (entry.bound == Bound::Exact ||
+        (entry.bound == Bound::Lower && score >= beta) || (entry.bound == Bound::Upper && score <= alpha)))
+      return score;
+  }
+
+  worker.stats.selectiveDepth = std::max(worker.stats.selectiveDepth, ply);
+
+  MoveList moves = game.findMoves();
+  if (moves.empty())
+  {
+    // Checkmate, faster mate is better. Stalemate is a draw
+    worker.stats.leafNodes ++;
+    return game.isChecking() ? -MATE_SCORE + ply : 0;
+  }
+
+  // Pruning is done only in null window nodes, the principal variation is searched fully
+  bool pvNode = beta - alpha > 1;
+  bool inCheck = game.isChecking();
+  bool canPrune = !pvNode && !inCheck && std::abs(beta) < MATE_BOUND;
+  int staticEval = canPrune ? evaluate(game) : 0;
+
+  // Even after losing the margin the position is too good, opponent will not allow it
+  if (m_options.reverseFutility && canPrune && depth <= REVERSE_FUTILITY_MAX_DEPTH &&
+      staticEval - REVERSE_FUTILITY_MARGIN * depth >= beta)
+  {
+    worker.stats.reverseFutilityCutoffs ++;
+    return staticEval;
+  }
+
+  // If passing the turn is still too good, making a move will be too (except zugzwang, so only with pieces)
+  if (m_options.nullMove && allowNullMove && canPrune && depth >= NULL_MOVE_MIN_DEPTH && staticEval >= beta &&
+      hasPieces(game, game.toMove()))
+  {
+    int reduction = NULL_MOVE_REDUCTION + depth / NULL_MOVE_DEPTH_STEP;
+    game.makeNullMove();
+    int score = -this -> negamax(worker, depth - 1 - reduction, ply + 1, -beta, -beta + 1, false);
+    game.undoNullMove();
+    if (m_stop)
+      return 0;
+
+    // Mate found by the reduced search is not proven
+    if (score >= beta)
     {
-      game.makeMove(from, to);
-      int eval = minimax(game, depth -1, alpha, beta, false);
-      game.undo();
-      maxEval = std::max(maxEval, eval);
-      alpha = std::max(alpha, eval);
-      if (beta <= alpha)
-        break;
+      worker.stats.nullMoveCutoffs ++;
+      return (score > MATE_BOUND) ? beta : score;
     }
-    std::cout << "Eval at depth " << depth << ": " << maxEval << std::endl;
-    return maxEval;
   }
-  
-  else
+
+  // Quiet moves can not get the score up to alpha near the leaves
+  bool futile = m_options.futility && canPrune && depth < static_cast<int>(FUTILITY_MARGIN.size()) &&
+                std::abs(alpha) < MATE_BOUND && staticEval + FUTILITY_MARGIN[depth] <= alpha;
+
+  this -> orderMoves(worker, moves, hashMove, ply);
+
+  int alphaOrig = alpha;
+  Move bestMove = moves[0];
+  int bestEval = -INFINITE_SCORE;
+  size_t searched = 0;
+  for (Move move: moves)
   {
-    int minEval = INT_MAX;
-    for (const auto & [from, to]: moves)
+    bool quiet = !move.isCapture();
+    bool reducible = m_options.lateMoveReductions && !inCheck && depth >= LMR_MIN_DEPTH && searched >= LMR_FULL_DEPTH_MOVES;
+
+    game.makeMove(move);
+
+    // Moves that give check are never pruned or reduced
+    bool givesCheck = quiet && (futile || reducible) && game.isChecking();
+    if (futile && searched > 0 && quiet && !givesCheck)
     {
-      game.makeMove(from, to);
-      int eval = minimax(game, depth -1, alpha, beta, true);
       game.undo();
-      minEval = std::min(minEval, eval);
-      beta = std::min(beta, eval);
-      if (beta <= alpha)
-        break;
+      worker.stats.futilityPrunes ++;
+      continue;
+    }
+
+    int eval;
+    if (searched == 0)
+      eval = -this -> negamax(worker, depth - 1, ply + 1, -beta, -alpha, true);
+    else
+    {
+      // Late quiet moves are most likely bad, they are searched less deep
+      int reduction = 0;
+      if (reducible && quiet && !givesCheck)
+      {
+        reduction = (searched >= 2 * LMR_FULL_DEPTH_MOVES && depth >= 2 * LMR_MIN_DEPTH) ? 2 : 1;
+        worker.stats.reductions ++;
+      }
+
+      // Null window proves that the move is not better than the best one so far
+      int windowBeta = m_options.pvs ? alpha + 1 : beta;
+      eval = -this -> negamax(worker, depth - 1 - reduction, ply + 1, -windowBeta, -alpha, true);
+
+      // Reduced move was better than expected, it has to be searched at full depth
+      if (reduction && eval > alpha)
+      {
+        worker.stats.reResearches ++;
+        eval = -this -> negamax(worker, depth - 1, ply + 1, -windowBeta, -alpha, true);
+      }
+
+      // Move is better, its exact score needs full window
+      if (windowBeta != beta && eval > alpha && eval < beta)
+        eval = -this -> negamax(worker, depth - 1, ply + 1, -beta, -alpha, true);
+    }
+    game.undo();
+    if (m_stop)
+      return 0;
+    searched ++;
+
+    if (eval > bestEval)
+    {
+      bestEval = eval;
+      bestMove = move;
+    }
+    alpha = std::max(alpha, eval);
+    if (alpha >= beta)
+    {
+      this -> updateCutoff(worker, move, depth, ply, searched == 1);
+      break;
     }
-    std::cout << "Eval at depth " << depth << ": " << minEval << std::endl;
-    return minEval;
   }
 
+  Bound bound = Bound::Exact;
+  if (bestEval <= alphaOrig)
+    bound = Bound::Upper;
+  else if (bestEval >= beta)
+    bound = Bound::Lower;
+  m_table.store(key, depth, bound, scoreToTable(bestEval, ply), bestMove.raw());
+
+  return bestEval;
 }
 
+/** Searches only captures (all moves when in check) until the position is quiet, so the evaluation is not done
+    in the middle of an exchange. Player to move can always stand pat (keep the static evaluation) instead */
+template <int Width, int Height>
+int Engine<Width, Height>::quiescence(Worker & worker, int ply, int alpha, int beta)
+{
+  worker.nodes.store(worker.nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  worker.stats.quiescenceNodes ++;
+  if (this -> shouldStop(worker))
+  {
+    m_stop = true;
+    return 0;
+  }
+
+  Game & game = worker.game;
+
+  TablebaseResult solved;
+  if (m_tablebases.probe(game, solved))
+  {
+    worker.stats.tablebaseHits ++;
+    return tablebaseScore(solved, ply);
+  }
+
+  worker.stats.selectiveDepth = std::max(worker.stats.selectiveDepth, ply);
+
+  // Player in check can not stand pat, without a way out it is checkmate
+  bool inCheck = game.isChecking();
+  int bestEval = -MATE_SCORE + ply;
+  if (!inCheck || ply >= MAX_PLY)
+  {
+    bestEval = lazyEvaluate(game, alpha, beta);
+    if (ply >= MAX_PLY || bestEval >= beta)
+    {
+      worker.stats.leafNodes ++;
+      return bestEval;
+    }
+    alpha = std::max(alpha, bestEval);
+  }
+
+  MoveList moves = game.findCaptures();
+  this -> orderMoves(worker, moves, Move(), ply);
+
+  size_t searched = 0;
+  for (Move move: moves)
+  {
+    // Capture that loses material can not be better than standing pat
+    if (!inCheck && game.staticExchange(move) < 0)
+      continue;
+
+    game.makeMove(move);
+    int eval = -this -> quiescence(worker, ply + 1, -beta, -alpha);
+    game.undo();
+    if (m_stop)
+      return 0;
+    searched ++;
+
+    bestEval = std::max(bestEval, eval);
+    alpha = std::max(alpha, eval);
+    if (alpha >= beta)
+    {
+      this -> updateCutoff(worker, move, 0, ply, searched == 1);
+      break;
+    }
+  }
+
+  if (searched == 0)
+    worker.stats.leafNodes ++;
+  return bestEval;
+}
 
+#define INSTANTIATE_ENGINE(width, height) template class Engine<width, height>;
+FOR_EACH_BOARD_SIZE(INSTANTIATE_ENGINE)
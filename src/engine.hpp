@@ -8,18 +8,368 @@
 #pragma once
 
 #include "chess.hpp"
+#include "transpositionTable.hpp"
+#include "tablebase.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Score of checkmate, mate in N plies is scored MATE_SCORE - N
+constexpr int MATE_SCORE = 10000;
+
+// Scores above this are mate scores
+constexpr int MATE_BOUND = MATE_SCORE - 1000;
+
+// Deepest iteration of the search
+constexpr int MAX_DEPTH = 64;
+
+// Maximal distance from the root
+constexpr int MAX_PLY = 128;
+
+// Bound of all scores, window of full search
+constexpr int INFINITE_SCORE = MATE_SCORE + 1;
+
+// When to stop searching, search ends when any of the limits is reached
+struct SearchLimits
+{
+  // Maximal depth
+  int depth = MAX_DEPTH;
+
+  // Maximal number of searched positions, 0 means no limit
+  std::uint64_t nodes = 0;
+
+  // Maximal time of the search, 0 means no limit
+  std::chrono::milliseconds time = std::chrono::milliseconds(0);
+
+  // Search of the position after the expected move of the opponent, done on its time. Node and time limits apply only
+  // after Engine::ponderHit (the opponent played the expected move), until then the search runs until stopped
+  bool ponder = false;
+
+  // Result is reported only after Engine::stop, even if the search ends earlier (UCI go infinite)
+  bool infinite = false;
+};
+
+// Techniques of the search that can be switched off (e.g. to see their effect in bench), all of them are on by default
+struct SearchOptions
+{
+  // Principal variation search, moves after the first one are only tested with null window to be worse
+  bool pvs = true;
+
+  // Root is searched with narrow window around the score of previous depth
+  bool aspiration = true;
+
+  // Position where passing the turn is still too good for the opponent is cut off by reduced search
+  bool nullMove = true;
+
+  // Late quiet moves are searched less deep, and again at full depth only if they turn out good
+  bool lateMoveReductions = true;
+
+  // Quiet moves that can not reach alpha near the leaves are skipped
+  bool futility = true;
+
+  // Position that stays above beta even after losing a margin near the leaves is cut off (static null move)
+  bool reverseFutility = true;
+};
+
+// What happened during one search, summed over all threads
+struct SearchStats
+{
+  // Searched positions
+  std::uint64_t nodes = 0;
+
+  // Positions evaluated without searching further (quiet position at the horizon, checkmate, stalemate)
+  std::uint64_t leafNodes = 0;
+
+  // Positions searched past the nominal depth to resolve captures (included in nodes)
+  std::uint64_t quiescenceNodes = 0;
+
+  // Positions where a move was too good for the opponent to allow, and how often it was the first searched move
+  std::uint64_t betaCutoffs = 0;
+  std::uint64_t firstMoveCutoffs = 0;
+
+  // Positions found in the transposition table
+  std::uint64_t ttHits = 0;
+
+  // Positions solved by endgame tablebases
+  std::uint64_t tablebaseHits = 0;
+
+  // Positions cut off by null move, reverse futility, and quiet moves skipped by futility pruning
+  std::uint64_t nullMoveCutoffs = 0;
+  std::uint64_t reverseFutilityCutoffs = 0;
+  std::uint64_t futilityPrunes = 0;
+
+  // Late moves searched with reduced depth and how many of them had to be searched again
+  std::uint64_t reductions = 0;
+  std::uint64_t reResearches = 0;
+
+  // Last finished depth and the deepest ply reached
+  int depth = 0;
+  int selectiveDepth = 0;
+
+  // Nodes of last finished depth divided by nodes of the depth before (main thread only)
+  double effectiveBranchingFactor = 0;
+
+  std::chrono::milliseconds elapsed = std::chrono::milliseconds(0);
+
+  /** Returns share of beta cutoffs caused by the first searched move (quality of move ordering) */
+  double firstMoveCutoffRate(void) const
+  {
+    return betaCutoffs ? static_cast<double>(firstMoveCutoffs) / betaCutoffs : 0;
+  }
+
+  /** Returns searched positions per second */
+  std::uint64_t nps(void) const
+  {
+    return elapsed.count() ? nodes * 1000 / elapsed.count() : 0;
+  }
+};
+
+// Best move with its score (positive is good for white) and statistics of the search
+struct SearchResult
+{
+  // No move if no move can be made
+  Move move = Move();
+  int score = 0;
+
+  // Expected answer of the opponent, worth pondering on (no move if it is not known)
+  Move ponderMove = Move();
+  SearchStats stats;
+};
+
+// Progress of the search, reported by the main thread after every finished depth
+struct SearchInfo
+{
+  int depth = 0;
+  int selectiveDepth = 0;
+
+  // Score from the view of the player to move at the root
+  int score = 0;
+
+  // Positions searched by all threads so far
+  std::uint64_t nodes = 0;
+  std::chrono::milliseconds elapsed = std::chrono::milliseconds(0);
+
+  // Expected moves of both players (principal variation), best move first
+  std::vector<Move> pv;
+};
+
+/* Search can run on more threads (Lazy SMP). Every thread searches its own copy of the game with slightly different
+   depths, they only share the transposition table and help each other through it. The main thread decides when to
+   stop and which move to play. Every board size has its own engine, so the board geometry is known at compile time.
+   Search threads live as long as the engine and sleep between searches, so starting a search creates no thread */
+template <int Width, int Height>
 class Engine
 {
   public:
-    Engine() {};
+    using Game = Chess<Width, Height>;
+
+    /** Constructor, size of transposition table in megabytes */
+    explicit Engine(size_t hashMegabytes = 16);
+
+    /** Stops the search and ends the search threads */
+    ~Engine();
 
-    /** Find the best move for current chess game*/
-    std::pair<Position, Position> findBestMove(Chess game, int depth);
+    /** Changes size of transposition table in megabytes (clears it) */
+    void setHashSize(size_t megabytes);
+
+    /** Forgets everything learned from previous searches (new game) */
+    void clearHash(void);
+
+    /** Sets number of threads used by the search (restarts the search threads). Must not be called during search */
+    void setThreads(int threads);
+
+    /** Switches techniques of the search on or off. Must not be called during search */
+    void setOptions(const SearchOptions & options)
+    {
+      m_options = options;
+    }
+
+    /** Loads endgame tablebases (*.tb) from directory, returns number of loaded tables. Must not be called during search */
+    size_t loadTablebases(const std::string & directory);
+
+    /** Loads evaluation network used instead of the handcrafted evaluation, returns false if the file is not a network
+        of this board size (the previous one is kept). Must not be called during search */
+    bool loadNetwork(const std::string & filename);
+
+    /** Find the best move for current chess game, searching to fixed depth */
+    SearchResult findBestMove(Game game, int depth);
+
+    /** Find the best move for current chess game, searching deeper until one of the limits runs out */
+    SearchResult findBestMove(Game game, const SearchLimits & limits);
+
+    /** Starts searching in the background and returns at once, search that is running is stopped first. The search
+        thread calls onFinished with the result when the search ends (limits ran out or stop was called) */
+    void startSearch(Game game, const SearchLimits & limits, std::function<void(const SearchResult &)> onFinished);
+
+    /** Waits until the running search ends and its onFinished returns (must not be called from the callbacks) */
+    void wait(void);
+
+    /** Returns true from startSearch until onFinished of the search returns */
+    bool isSearching(void);
+
+    /** Sets function called by the searching thread after every finished depth (empty function switches it off). Must
+        not be called during search */
+    void setInfoCallback(std::function<void(const SearchInfo &)> callback)
+    {
+      m_infoCallback = std::move(callback);
+    }
+
+    /** Turns running ponder search into normal one (can be called from other thread), limits are counted from now */
+    void ponderHit(void)
+    {
+      m_startTime = std::chrono::steady_clock::now();
+      m_pondering = false;
+      this -> wakeMain();
+    }
+
+    /** Stops the running search (can be called from other thread), best move from last finished depth is returned.
+        Every searched position checks the flag, so the search ends within a millisecond */
+    void stop(void)
+    {
+      m_stop.store(true, std::memory_order_relaxed);
+      this -> wakeMain();
+    }
+
+    /** Returns number of positions searched by all threads */
+    std::uint64_t nodes(void) const;
 
   private:
+    static constexpr int SQUARE_COUNT = Game::SQUARE_COUNT;
+
+    // State of one search thread
+    struct Worker
+    {
+      Worker(int id, const Game & game, const MoveList & rootMoves)
+        : id(id), game(game), rootMoves(rootMoves)
+      {};
+
+      // Main thread has id 0
+      int id;
+      Game game;
+      MoveList rootMoves;
+
+      // Written only by the thread itself, read by the main thread to check the node limit
+      std::atomic<std::uint64_t> nodes = 0;
+
+      // Statistics of this thread, nodes are counted above
+      SearchStats stats;
+
+      // Result of last finished depth, score is from the view of the player to move at the root
+      Move bestMove = Move();
+      int bestScore = 0;
+
+      // Two last quiet moves that caused beta cutoff at each ply
+      std::array<std::array<Move, 2>, MAX_PLY> killers = {};
+
+      // How often quiet moves caused beta cutoff, indexed by [Color][from][to]
+      std::array<std::array<std::array<int, SQUARE_COUNT>, SQUARE_COUNT>, 2> history = {};
+    };
+
+    /** Orders moves so the most promising ones are searched first */
+    void orderMoves(const Worker & worker, MoveList & moves, Move hashMove, int ply) const;
+
+    /** Counts beta cutoff and remembers quiet move that caused it as killer move and in history table */
+    void updateCutoff(Worker & worker, Move move, int depth, int ply, bool firstMove);
+
+    /** Starts the search threads, they sleep in threadLoop until a search starts */
+    void startThreads(void);
+
+    /** Stops the search and ends the search threads */
+    void stopThreads(void);
+
+    /** Body of search thread with given id, runs every started search until the engine quits */
+    void threadLoop(int id, std::uint64_t searchId);
+
+    /** Wakes the main thread if it waits for the end of pondering or infinite search */
+    void wakeMain(void)
+    {
+      // Taking the lock orders the flag change before the check of the waiting thread, so the wake up is not lost
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+      }
+      m_ponderEnd.notify_all();
+    }
+
+    /** Runs the search of the main thread, waits for the helpers and reports the result */
+    void searchMain(void);
+
+    /** Returns best move of the finished search with statistics summed over all threads */
+    SearchResult collectResult(void) const;
+
+    /** Searches deeper and deeper until stopped, result of the last finished depth is kept in the worker */
+    void iterativeDeepening(Worker & worker);
+
+    /** Searches all moves at the root to given depth inside of the window, returns false if the search was stopped
+        before finishing. Best move is moved to the front */
+    bool searchRoot(Worker & worker, int depth, int alpha, int beta, int & bestScore);
+
+    /** Returns principal variation starting with given move, the rest is followed through the transposition table */
+    std::vector<Move> principalVariation(Game game, Move first, int maxLength) const;
+
+    /** Checks if the search should stop, limits are checked by the main thread every few thousand positions */
+    bool shouldStop(const Worker & worker);
     
-    /** Minimax algorithm to find the best move */
-    int minimax(Chess & game, int depth, int alpha, int beta, bool maximizingPlayer);
-};
+    /** Negamax principal variation search, returns score from the view of the player to move. Ply is distance from
+        the root, null move is not allowed twice in a row */
+    int negamax(Worker & worker, int depth, int ply, int alpha, int beta, bool allowNullMove);
+
+    /** Searches only captures (all moves when in check) until the position is quiet, so the evaluation is not done
+        in the middle of an exchange. Player to move can always stand pat (keep the static evaluation) instead */
+    int quiescence(Worker & worker, int ply, int alpha, int beta);
+
+    // Results of already searched positions, shared by all threads
+    TranspositionTable m_table;
 
+    // Solved endgames, shared by all threads
+    Tablebases m_tablebases;
+
+    // Evaluation network shared by all threads, handcrafted evaluation is used without it
+    std::unique_ptr<Network> m_network;
+
+    int m_threads = 1;
+
+    SearchOptions m_options;
+
+    // Called after every finished depth of the main thread
+    std::function<void(const SearchInfo &)> m_infoCallback;
+
+    // Limits of the running search
+    SearchLimits m_limits;
+    std::atomic<std::chrono::steady_clock::time_point> m_startTime;
+
+    // Set while pondering, limits do not apply until the opponent plays the expected move
+    std::atomic<bool> m_pondering = false;
+
+    // Threads of the running (or last) search
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // Set when the running search should stop as soon as possible
+    std::atomic<bool> m_stop = false;
+
+    // Position of the running search, result known without searching (single or no legal move) and who gets the result
+    Game m_root;
+    SearchResult m_trivialResult;
+    std::function<void(const SearchResult &)> m_onFinished;
+
+    // Search threads, the first one is the main thread of every search
+    std::vector<std::thread> m_pool;
+
+    // Guards the state below, threads wake up when the search id changes or the engine quits, the main thread of a
+    // ponder or infinite search waits on m_ponderEnd until ponderHit or stop
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_finished;
+    std::condition_variable m_ponderEnd;
+    std::uint64_t m_searchId = 0;
+    int m_runningHelpers = 0;
+    bool m_searching = false;
+    bool m_quit = false;
+};
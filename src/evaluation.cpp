@@ -0,0 +1,69 @@
+/**
+ * @file evaluation.cpp
+ * @author Ondrej
+ * @brief Evaluation weights and vectorized kernel scoring mobility and king attacks of all pieces at once
+ *
+*/
+
+#include "evaluation.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+/** Returns sum of the four 32 bit lanes */
+static int horizontalSum(__m128i sum)
+{
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+/** Returns sum of features times weights of all pieces (white - black). Uses AVX2 or SSE2 when the compiler targets
+    them (-mavx2), plain loop otherwise */
+TaperedScore scorePieces(const EvalPieceList & pieces)
+{
+  TaperedScore score;
+  const std::int16_t * features = pieces.features.data();
+  const std::int16_t * weightsMg = pieces.weightsMg.data();
+  const std::int16_t * weightsEg = pieces.weightsEg.data();
+  int count = 2 * pieces.size;
+  int i = 0;
+
+  // madd multiplies 16 bit lanes and adds neighbouring products, which are the two features of one piece
+#if defined(__AVX2__)
+  __m256i mg = _mm256_setzero_si256();
+  __m256i eg = _mm256_setzero_si256();
+  for (; i + 16 <= count; i += 16)
+  {
+    __m256i f = _mm256_load_si256(reinterpret_cast<const __m256i *>(features + i));
+    mg = _mm256_add_epi32(mg, _mm256_madd_epi16(f, _mm256_load_si256(reinterpret_cast<const __m256i *>(weightsMg + i))));
+    eg = _mm256_add_epi32(eg, _mm256_madd_epi16(f, _mm256_load_si256(reinterpret_cast<const __m256i *>(weightsEg + i))));
+  }
+  score.mg = horizontalSum(_mm_add_epi32(_mm256_castsi256_si128(mg), _mm256_extracti128_si256(mg, 1)));
+  score.eg = horizontalSum(_mm_add_epi32(_mm256_castsi256_si128(eg), _mm256_extracti128_si256(eg, 1)));
+#elif defined(__SSE2__)
+  __m128i mg = _mm_setzero_si128();
+  __m128i eg = _mm_setzero_si128();
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i f = _mm_load_si128(reinterpret_cast<const __m128i *>(features + i));
+    mg = _mm_add_epi32(mg, _mm_madd_epi16(f, _mm_load_si128(reinterpret_cast<const __m128i *>(weightsMg + i))));
+    eg = _mm_add_epi32(eg, _mm_madd_epi16(f, _mm_load_si128(reinterpret_cast<const __m128i *>(weightsEg + i))));
+  }
+  score.mg = horizontalSum(mg);
+  score.eg = horizontalSum(eg);
+#endif
+
+  // Pieces that do not fill a whole vector
+  for (; i < count; i ++)
+  {
+    score.mg += features[i] * weightsMg[i];
+    score.eg += features[i] * weightsEg[i];
+  }
+  return score;
+}
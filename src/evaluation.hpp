@@ -0,0 +1,77 @@
+/**
+ * @file evaluation.hpp
+ * @author Ondrej
+ * @brief Evaluation weights and vectorized kernel scoring mobility and king attacks of all pieces at once
+ *
+*/
+
+#pragma once
+
+#include "bitboard.hpp"
+
+#include <array>
+#include <cstdint>
+
+// Contribution of each piece type to the game phase, indexed by PieceType. Phase goes down as pieces are traded and
+// evaluation moves from middlegame towards endgame weights
+constexpr std::array<int, 6> PHASE_WEIGHTS = {0, 4, 2, 1, 1, 0};
+
+// Centipawns for each safe square a piece attacks (not own piece, not attacked by enemy pawn), indexed by PieceType
+constexpr std::array<int, 6> MOBILITY_MG = {0, 1, 2, 5, 4, 0};
+constexpr std::array<int, 6> MOBILITY_EG = {0, 2, 4, 5, 4, 0};
+
+// Centipawns for each square around the enemy king a piece attacks, only in middlegame when there is enough material
+// to attack the king
+constexpr std::array<int, 6> KING_ATTACK_MG = {0, 5, 3, 2, 2, 0};
+
+// Score in middlegame and in endgame, mixed by the game phase
+struct TaperedScore
+{
+  int mg = 0;
+  int eg = 0;
+
+  constexpr TaperedScore & operator+=(const TaperedScore & other)
+  {
+    mg += other.mg;
+    eg += other.eg;
+    return *this;
+  }
+
+  constexpr TaperedScore & operator-=(const TaperedScore & other)
+  {
+    mg -= other.mg;
+    eg -= other.eg;
+    return *this;
+  }
+};
+
+/* Pieces of one position in structure of arrays layout for the kernel. Each piece has two features (mobility and
+   attacks around the enemy king) stored next to each other, with the weights of its type in the same slots of the
+   weight arrays. Weights of black pieces are negative, so the sum is from the view of white. Slots after the last
+   piece are left uninitialized, the kernel does not read them */
+struct EvalPieceList
+{
+  static constexpr int CAPACITY = MAX_SQUARES;
+
+  alignas(32) std::array<std::int16_t, 2 * CAPACITY> features;
+  alignas(32) std::array<std::int16_t, 2 * CAPACITY> weightsMg;
+  alignas(32) std::array<std::int16_t, 2 * CAPACITY> weightsEg;
+  int size = 0;
+
+  /** Adds piece of given type (PieceType as int) with its number of safe squares and attacked squares around the king */
+  void push(int type, bool white, int mobility, int kingAttacks)
+  {
+    int sign = white ? 1 : -1;
+    int slot = 2 * size ++;
+    features[slot] = static_cast<std::int16_t>(mobility);
+    features[slot + 1] = static_cast<std::int16_t>(kingAttacks);
+    weightsMg[slot] = static_cast<std::int16_t>(sign * MOBILITY_MG[type]);
+    weightsMg[slot + 1] = static_cast<std::int16_t>(sign * KING_ATTACK_MG[type]);
+    weightsEg[slot] = static_cast<std::int16_t>(sign * MOBILITY_EG[type]);
+    weightsEg[slot + 1] = 0;
+  }
+};
+
+/** Returns sum of features times weights of all pieces (white - black). Uses AVX2 or SSE2 when the compiler targets
+    them (-mavx2), plain loop otherwise */
+TaperedScore scorePieces(const EvalPieceList & pieces);
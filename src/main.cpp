@@ -11,14 +11,12 @@
 
 /**
  * @ Manages the whole program
- * - Argument : Positive ingeger N that stands for the depth of MinMax Algorithm
+ * - Argument : Board size S (S x S squares, 4 to 8), default is 5. The AI has fixed time per move (AI_MOVE_TIME)
 */
 
 int main (int argc, char ** argv)
 {
-  
-  // Default depth
-  size_t depth = 8;
+  int size = DEFAULT_BOARD_SIZE;
   
   if (argc > 2)
     return EXIT_FAILURE;
@@ -26,15 +24,18 @@ int main (int argc, char ** argv)
   if (argc == 2)
   {
     std::istringstream parse(argv[1]);
-    if (!parse >> depth)
+    if (!(parse >> size) || !isSupportedBoard(size, size))
       return EXIT_FAILURE;
   }
 
   unsigned screenWidth = sf::VideoMode::getDesktopMode().width;
   unsigned screenHeight = sf::VideoMode::getDesktopMode().height;
-  BoardVisualisation board(screenWidth, screenHeight); 
-  /* Runs the main window loop*/
-  board.mainLoop();
+  withBoardSize(size, size, [&]<int Width, int Height>(Board<Width, Height>)
+  {
+    BoardVisualisation<Width, Height> board(screenWidth, screenHeight); 
+    /* Runs the main window loop*/
+    board.mainLoop();
+  });
     
 }
 
@@ -0,0 +1,478 @@
+/**
+ * @file match.cpp
+ * @author Ondrej
+ * @brief Plays games between two engine configurations in parallel and tells which one is stronger (Elo, SPRT)
+ *
+*/
+
+#include "engine.hpp"
+#include "nnue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Game that lasts this many plies is a draw
+constexpr int DEFAULT_MAX_PLIES = 300;
+
+// Game is won when the score of both engines stays at least this high (from the view of the same player) for
+// RESIGN_PLIES plies in a row
+constexpr int RESIGN_SCORE = 1000;
+constexpr int RESIGN_PLIES = 8;
+
+// Standing is printed after every REPORT_INTERVAL finished games
+constexpr int REPORT_INTERVAL = 50;
+
+// Result of one game from the view of engine A
+enum class GameResult
+{
+  Win,
+  Draw,
+  Loss
+};
+
+// Configuration of one of the engines
+struct PlayerOptions
+{
+  SearchOptions search;
+  std::string network;
+};
+
+// Settings of the whole match
+struct MatchOptions
+{
+  // Engine A is the one being tested, engine B is the reference
+  std::array<PlayerOptions, 2> players;
+  SearchLimits limits;
+  size_t hash = 16;
+  std::string tablebases;
+
+  int games = 1000;
+  int concurrency = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  int maxPlies = DEFAULT_MAX_PLIES;
+  int boardSize = DEFAULT_BOARD_SIZE;
+  std::string openings;
+
+  // SPRT tests H0: A is elo0 stronger than B, against H1: A is elo1 stronger, with false positive rate alpha and false
+  // negative rate beta
+  double elo0 = 0;
+  double elo1 = 20;
+  double alpha = 0.05;
+  double beta = 0.05;
+};
+
+/** Returns expected score of player that is elo points stronger */
+static double eloToScore(double elo)
+{
+  return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+/** Returns Elo difference that gives the expected score */
+static double scoreToElo(double score)
+{
+  score = std::clamp(score, 1e-6, 1 - 1e-6);
+  return -400 * std::log10(1 / score - 1);
+}
+
+// Games finished so far, from the view of engine A
+struct MatchScore
+{
+  int wins = 0;
+  int draws = 0;
+  int losses = 0;
+
+  int games(void) const
+  {
+    return wins + draws + losses;
+  }
+
+  /** Returns average points per game (win 1, draw 0.5) */
+  double score(void) const
+  {
+    return games() ? (wins + draws * 0.5) / games() : 0.5;
+  }
+
+  /** Returns variance of points of one game */
+  double variance(void) const
+  {
+    double s = this -> score();
+    return games() ? (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / games() : 0;
+  }
+
+  double elo(void) const
+  {
+    return scoreToElo(this -> score());
+  }
+
+  /** Returns half of the 95 % confidence interval of the Elo difference */
+  double eloError(void) const
+  {
+    if (!games())
+      return 0;
+    double margin = 1.96 * std::sqrt(this -> variance() / games());
+    return (scoreToElo(this -> score() + margin) - scoreToElo(this -> score() - margin)) / 2;
+  }
+
+  /** Returns log-likelihood ratio of H1 (elo1) against H0 (elo0), normal approximation of the game results */
+  double llr(double elo0, double elo1) const
+  {
+    double variance = this -> variance();
+    if (variance <= 0)
+      return 0;
+    double s0 = eloToScore(elo0);
+    double s1 = eloToScore(elo1);
+    return games() * (s1 - s0) * (2 * this -> score() - s0 - s1) / (2 * variance);
+  }
+};
+
+/** Switches off technique of the search given by its name, returns false if there is no such technique */
+static bool disableTechnique(const std::string & name, SearchOptions & search)
+{
+  if (name == "pvs")
+    search.pvs = false;
+  else if (name == "aspiration")
+    search.aspiration = false;
+  else if (name == "nullmove")
+    search.nullMove = false;
+  else if (name == "lmr")
+    search.lateMoveReductions = false;
+  else if (name == "futility")
+    search.futility = false;
+  else if (name == "rfp")
+    search.reverseFutility = false;
+  else
+    return false;
+  return true;
+}
+
+/** Returns positions after every pair of first moves from the setup, used when no openings are given */
+static std::vector<std::string> defaultOpenings(int boardSize)
+{
+  std::vector<std::string> openings;
+  withBoardSize(boardSize, boardSize, [&]<int Width, int Height>(Board<Width, Height>)
+  {
+    Chess<Width, Height> game(Chess<Width, Height>::setup(), Color::White);
+    for (Move first: game.findMoves())
+    {
+      game.makeMove(first);
+      for (Move second: game.findMoves())
+      {
+        game.makeMove(second);
+        openings.push_back(game.fen());
+        game.undo();
+      }
+      game.undo();
+    }
+  });
+  return openings;
+}
+
+/** Reads openings from file (one FEN per line) and their board size, returns false if the file can not be read, a FEN
+    is invalid or the openings are on boards of different sizes */
+static bool loadOpenings(const std::string & filename, std::vector<std::string> & openings, int & boardWidth, int & boardHeight)
+{
+  std::ifstream file(filename);
+  if (!file)
+    return false;
+
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty())
+      continue;
+
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    if (fenBoardSize(line, width, height))
+    {
+      withBoardSize(width, height, [&]<int Width, int Height>(Board<Width, Height>)
+      {
+        valid = Chess<Width, Height>().loadFen(line);
+      });
+    }
+    if (!valid)
+    {
+      std::cerr << "Invalid opening " << line << std::endl;
+      return false;
+    }
+
+    // Engines of the threads are made for one board size
+    if (!openings.empty() && (width != boardWidth || height != boardHeight))
+    {
+      std::cerr << "Opening " << line << " is on other board than the first one" << std::endl;
+      return false;
+    }
+    boardWidth = width;
+    boardHeight = height;
+    openings.push_back(line);
+  }
+  return true;
+}
+
+/** Sets engine up as the player, its network is already checked by main */
+template <int Width, int Height>
+static void setupEngine(Engine<Width, Height> & engine, const PlayerOptions & player, const MatchOptions & options)
+{
+  engine.setOptions(player.search);
+  if (!options.tablebases.empty())
+    engine.loadTablebases(options.tablebases);
+  if (!player.network.empty())
+    engine.loadNetwork(player.network);
+}
+
+/** Plays one game from the opening, returns result from the view of engine A */
+template <int Width, int Height>
+static GameResult playGame(Engine<Width, Height> & engineA, Engine<Width, Height> & engineB, const std::string & opening,
+                           bool whiteIsA, const MatchOptions & options)
+{
+  // Engines forget the previous game, so the result does not depend on the games played before
+  engineA.clearHash();
+  engineB.clearHash();
+
+  Chess<Width, Height> game;
+  game.loadFen(opening);
+  auto winner = [whiteIsA](Color color) {return (color == Color::White) == whiteIsA ? GameResult::Win : GameResult::Loss;};
+
+  // Positions seen in the game, third repetition is a draw
+  std::unordered_map<std::uint64_t, int> seen;
+  seen[game.hash()] ++;
+
+  // Plies in a row where both engines see white (index 0) or black (index 1) winning
+  std::array<int, 2> winning = {0, 0};
+
+  for (int ply = 0; ply < options.maxPlies; ply ++)
+  {
+    Color toMove = game.toMove();
+    if (game.findMoves().empty())
+      return game.isChecking() ? winner(toMove == Color::White ? Color::Black : Color::White) : GameResult::Draw;
+
+    Engine<Width, Height> & engine = (toMove == Color::White) == whiteIsA ? engineA : engineB;
+    SearchResult result = engine.findBestMove(game, options.limits);
+    game.makeMove(result.move);
+
+    if (++ seen[game.hash()] >= 3)
+      return GameResult::Draw;
+
+    // Two kings can not mate each other
+    if (popCount(game.occupied()) <= 2)
+      return GameResult::Draw;
+
+    // Score is from the view of white
+    winning[0] = result.score >= RESIGN_SCORE ? winning[0] + 1 : 0;
+    winning[1] = result.score <= -RESIGN_SCORE ? winning[1] + 1 : 0;
+    if (winning[0] >= RESIGN_PLIES)
+      return winner(Color::White);
+    if (winning[1] >= RESIGN_PLIES)
+      return winner(Color::Black);
+  }
+  return GameResult::Draw;
+}
+
+/** Prints standing of the match */
+static void printStanding(const MatchScore & score, const MatchOptions & options)
+{
+  double lower = std::log(options.beta / (1 - options.alpha));
+  double upper = std::log((1 - options.beta) / options.alpha);
+  std::cout << "Games " << std::setw(5) << score.games() << ": +" << score.wins << " =" << score.draws << " -" << score.losses
+            << "  Elo " << std::showpos << std::fixed << std::setprecision(1) << score.elo() << std::noshowpos << " +- "
+            << score.eloError() << "  LLR " << std::setprecision(2) << score.llr(options.elo0, options.elo1) << " ["
+            << lower << ", " << upper << "]" << std::endl;
+}
+
+/** Prints how to use the program */
+static void printUsage(void)
+{
+  std::cerr << "Usage: match [-games <n>] [-concurrency <n>] [-depth <n>] [-nodes <n>] [-time <ms>] [-hash <mb>] [-size <n>] [-openings <file>] [-maxplies <n>] [-tablebases <dir>] [-nnueA <file>] [-nnueB <file>] [-disableA <technique>] [-disableB <technique>] [-elo0 <elo>] [-elo1 <elo>] [-alpha <p>] [-beta <p>]" << std::endl
+            << "  -games       maximal number of games, played in pairs with switched colors (default 1000)" << std::endl
+            << "  -concurrency games played at once (default number of cores)" << std::endl
+            << "  -depth       search every move to fixed depth" << std::endl
+            << "  -nodes       search every move until node limit (default 20000)" << std::endl
+            << "  -time        search every move for given time in milliseconds" << std::endl
+            << "  -hash        transposition table size of each engine in megabytes" << std::endl
+            << "  -size        board size of the default openings (positions after two plies from the setup)" << std::endl
+            << "  -openings    file with start positions, one FEN per line" << std::endl
+            << "  -maxplies    game that lasts longer is a draw (default " << DEFAULT_MAX_PLIES << ")" << std::endl
+            << "  -tablebases  directory with endgame tables used by both engines" << std::endl
+            << "  -nnueA/B     evaluation network of engine A or B" << std::endl
+            << "  -disableA/B  switch off pvs, aspiration, nullmove, lmr, futility or rfp in engine A or B (can be repeated)" << std::endl
+            << "  -elo0/1      Elo difference of A over B under H0 and H1 of the SPRT (default 0 and 20)" << std::endl
+            << "  -alpha/beta  false positive and false negative rate of the SPRT (default 0.05)" << std::endl;
+}
+
+/**
+ * @ Plays the match, engine A is the tested configuration, engine B the reference
+ * - Arguments : options described in printUsage
+*/
+int main(int argc, char ** argv)
+{
+  MatchOptions options;
+  options.limits.nodes = 20000;
+
+  for (int i = 1; i < argc; i ++)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+
+    std::istringstream parse(argv[++ i]);
+    bool parsed = true;
+    if (arg == "-games")
+      parsed = static_cast<bool>(parse >> options.games);
+    else if (arg == "-concurrency")
+      parsed = static_cast<bool>(parse >> options.concurrency) && options.concurrency > 0;
+    else if (arg == "-depth")
+    {
+      parsed = static_cast<bool>(parse >> options.limits.depth);
+      options.limits.nodes = 0;
+    }
+    else if (arg == "-nodes")
+      parsed = static_cast<bool>(parse >> options.limits.nodes);
+    else if (arg == "-time")
+    {
+      int milliseconds = 0;
+      parsed = static_cast<bool>(parse >> milliseconds);
+      options.limits.time = std::chrono::milliseconds(milliseconds);
+      options.limits.nodes = 0;
+    }
+    else if (arg == "-hash")
+      parsed = static_cast<bool>(parse >> options.hash);
+    else if (arg == "-size")
+      parsed = static_cast<bool>(parse >> options.boardSize) && isSupportedBoard(options.boardSize, options.boardSize);
+    else if (arg == "-openings")
+      options.openings = argv[i];
+    else if (arg == "-maxplies")
+      parsed = static_cast<bool>(parse >> options.maxPlies);
+    else if (arg == "-tablebases")
+      options.tablebases = argv[i];
+    else if (arg == "-nnueA" || arg == "-nnueB")
+      options.players[arg.back() == 'B'].network = argv[i];
+    else if (arg == "-disableA" || arg == "-disableB")
+      parsed = disableTechnique(argv[i], options.players[arg.back() == 'B'].search);
+    else if (arg == "-elo0")
+      parsed = static_cast<bool>(parse >> options.elo0);
+    else if (arg == "-elo1")
+      parsed = static_cast<bool>(parse >> options.elo1);
+    else if (arg == "-alpha")
+      parsed = static_cast<bool>(parse >> options.alpha) && options.alpha > 0 && options.alpha < 1;
+    else if (arg == "-beta")
+      parsed = static_cast<bool>(parse >> options.beta) && options.beta > 0 && options.beta < 1;
+    else
+      parsed = false;
+
+    if (!parsed)
+    {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<std::string> openings;
+  int width = options.boardSize;
+  int height = options.boardSize;
+  if (options.openings.empty())
+    openings = defaultOpenings(options.boardSize);
+  else if (!loadOpenings(options.openings, openings, width, height))
+  {
+    std::cerr << "Can not read openings " << options.openings << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (openings.empty())
+  {
+    std::cerr << "No openings" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Engine keeps the handcrafted evaluation when its network does not load, the match would not test the network
+  for (const PlayerOptions & player: options.players)
+  {
+    if (!player.network.empty() && !Network().load(player.network, width, height))
+    {
+      std::cerr << "Can not load evaluation network " << player.network << " for " << width << "x" << height << " board" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Playing up to " << options.games << " games from " << openings.size() << " openings, " << options.concurrency
+            << " at once" << std::endl;
+
+  double lower = std::log(options.beta / (1 - options.alpha));
+  double upper = std::log((1 - options.beta) / options.alpha);
+  MatchScore score;
+  std::mutex scoreMutex;
+  std::atomic<int> nextGame = 0;
+  std::atomic<bool> decided = false;
+
+  // Every thread takes the next game until the games run out or the SPRT decides. Games 2k and 2k + 1 are played from
+  // the same opening with switched colors
+  auto playGames = [&]()
+  {
+    withBoardSize(width, height, [&]<int Width, int Height>(Board<Width, Height>)
+    {
+      // Engines live as long as the thread, tablebases and networks are loaded only once
+      Engine<Width, Height> engineA(options.hash);
+      Engine<Width, Height> engineB(options.hash);
+      setupEngine(engineA, options.players[0], options);
+      setupEngine(engineB, options.players[1], options);
+
+      while (!decided)
+      {
+        int index = nextGame ++;
+        if (index >= options.games)
+          return;
+
+        const std::string & opening = openings[(index / 2) % openings.size()];
+        GameResult result = playGame(engineA, engineB, opening, index % 2 == 0, options);
+
+        std::lock_guard<std::mutex> lock(scoreMutex);
+        if (decided)
+          return;
+        if (result == GameResult::Win)
+          score.wins ++;
+        else if (result == GameResult::Draw)
+          score.draws ++;
+        else
+          score.losses ++;
+
+        if (score.games() % REPORT_INTERVAL == 0)
+          printStanding(score, options);
+
+        double llr = score.llr(options.elo0, options.elo1);
+        if (llr <= lower || llr >= upper)
+          decided = true;
+      }
+    });
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.concurrency; i ++)
+    threads.emplace_back(playGames);
+  for (auto & thread: threads)
+    thread.join();
+
+  std::cout << std::endl;
+  printStanding(score, options);
+  double llr = score.llr(options.elo0, options.elo1);
+  std::cout << std::defaultfloat;
+  if (llr >= upper)
+    std::cout << "H1 accepted: A is stronger than B (elo0 " << options.elo0 << ", elo1 " << options.elo1 << ")" << std::endl;
+  else if (llr <= lower)
+    std::cout << "H0 accepted: A is not stronger than B (elo0 " << options.elo0 << ", elo1 " << options.elo1 << ")" << std::endl;
+  else
+    std::cout << "SPRT undecided after " << score.games() << " games" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file move.hpp
+ * @author Ondrej
+ * @brief Compact move encoding and fixed size move list
+ *
+*/
+
+#pragma once
+
+#include "bitboard.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+static_assert(MAX_SQUARES <= 64, "Square does not fit into 6 bits of the move");
+
+// Special meaning of the move, stored in the top 4 bits. Bit 2 marks captures. This game has no promotion, castling,
+// en passant nor double pawn push, so captures are the only special moves
+enum class MoveFlag : std::uint8_t
+{
+  Quiet = 0,
+  Capture = 4
+};
+
+/* Move packed into 16 bits: from square | to square << 6 | flag << 12. Value 0 is no move (from and to are never the same) */
+class Move
+{
+  public:
+    /** Leaves the move uninitialized (so move lists are not cleared), Move() or Move{} is no move */
+    Move() = default;
+
+    constexpr Move(Square from, Square to, MoveFlag flag = MoveFlag::Quiet)
+      : m_data(static_cast<std::uint16_t>(from | (to << 6) | (static_cast<int>(flag) << 12)))
+    {};
+
+    /** Constructor from packed value (e.g. stored in transposition table) */
+    constexpr explicit Move(std::uint16_t data)
+      : m_data(data)
+    {};
+
+    constexpr Square from(void) const
+    {
+      return m_data & 63;
+    }
+
+    constexpr Square to(void) const
+    {
+      return (m_data >> 6) & 63;
+    }
+
+    constexpr MoveFlag flag(void) const
+    {
+      return static_cast<MoveFlag>(m_data >> 12);
+    }
+
+    /** Returns true if the move takes a piece (including en passant) */
+    constexpr bool isCapture(void) const
+    {
+      return m_data & (4 << 12);
+    }
+
+    /** Returns packed value */
+    constexpr std::uint16_t raw(void) const
+    {
+      return m_data;
+    }
+
+    /** Returns false for no move */
+    constexpr explicit operator bool(void) const
+    {
+      return m_data != 0;
+    }
+
+    constexpr bool operator==(const Move & other) const = default;
+
+  private:
+    std::uint16_t m_data;
+};
+
+// More moves than any position can have (218 on 8x8 board)
+constexpr size_t MAX_MOVES = 256;
+
+/* Moves of one position, stored inline so it can live on the stack of the search without allocating */
+class MoveList
+{
+  public:
+    void push(Move move)
+    {
+      m_moves[m_size ++] = move;
+    }
+
+    size_t size(void) const
+    {
+      return m_size;
+    }
+
+    bool empty(void) const
+    {
+      return m_size == 0;
+    }
+
+    Move & operator[](size_t index)
+    {
+      return m_moves[index];
+    }
+
+    const Move & operator[](size_t index) const
+    {
+      return m_moves[index];
+    }
+
+    Move * begin(void)
+    {
+      return m_moves.data();
+    }
+
+    Move * end(void)
+    {
+      return m_moves.data() + m_size;
+    }
+
+    const Move * begin(void) const
+    {
+      return m_moves.data();
+    }
+
+    const Move * end(void) const
+    {
+      return m_moves.data() + m_size;
+    }
+
+  private:
+    // Only the first m_size moves are valid, the rest is left uninitialized
+    std::array<Move, MAX_MOVES> m_moves;
+    size_t m_size = 0;
+};
@@ -0,0 +1,126 @@
+/**
+ * @file nnue.cpp
+ * @author Ondrej
+ * @brief Efficiently updatable neural network evaluation, loaded from file
+ *
+*/
+
+#include "nnue.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/** Loads the network, returns false if the file is missing, damaged or made for different board */
+bool Network::load(const std::string & filename, int width, int height)
+{
+  std::ifstream file(filename, std::ios::binary);
+  NetworkHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    return false;
+
+  if (header.magic != NetworkHeader().magic || header.width != width || header.height != height || header.hidden != NNUE_HIDDEN)
+    return false;
+
+  size_t squareCount = static_cast<size_t>(width * height);
+  size_t features = squareCount * NNUE_PIECE_KINDS * squareCount;
+  std::vector<std::int16_t> hiddenWeights(features * NNUE_HIDDEN);
+  std::array<std::int16_t, NNUE_HIDDEN> hiddenBiases;
+  std::array<std::int8_t, 2 * NNUE_HIDDEN> outputWeights;
+  std::int32_t outputBias;
+
+  file.read(reinterpret_cast<char *>(hiddenBiases.data()), sizeof(hiddenBiases));
+  file.read(reinterpret_cast<char *>(hiddenWeights.data()), static_cast<std::streamsize>(hiddenWeights.size() * sizeof(std::int16_t)));
+  file.read(reinterpret_cast<char *>(outputWeights.data()), sizeof(outputWeights));
+  file.read(reinterpret_cast<char *>(&outputBias), sizeof(outputBias));
+
+  // Whole file has to be read, nothing may be left
+  if (!file || file.peek() != std::ifstream::traits_type::eof())
+    return false;
+
+  m_hiddenWeights = std::move(hiddenWeights);
+  m_hiddenBiases = hiddenBiases;
+  std::copy(outputWeights.begin(), outputWeights.end(), m_outputWeights.begin());
+  m_outputBias = outputBias;
+  return true;
+}
+
+/** Sets accumulator to the biases (position without pieces) */
+void Network::reset(Accumulator & accumulator) const
+{
+  accumulator.values = m_hiddenBiases;
+}
+
+/** Adds feature to accumulator */
+void Network::addFeature(Accumulator & accumulator, size_t feature) const
+{
+  const std::int16_t * weights = m_hiddenWeights.data() + feature * NNUE_HIDDEN;
+#if defined(__AVX2__)
+  for (int i = 0; i < NNUE_HIDDEN; i += 16)
+  {
+    __m256i * values = reinterpret_cast<__m256i *>(accumulator.values.data() + i);
+    *values = _mm256_add_epi16(*values, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + i)));
+  }
+#else
+  for (int i = 0; i < NNUE_HIDDEN; i ++)
+    accumulator.values[i] = static_cast<std::int16_t>(accumulator.values[i] + weights[i]);
+#endif
+}
+
+/** Subtracts feature from accumulator */
+void Network::removeFeature(Accumulator & accumulator, size_t feature) const
+{
+  const std::int16_t * weights = m_hiddenWeights.data() + feature * NNUE_HIDDEN;
+#if defined(__AVX2__)
+  for (int i = 0; i < NNUE_HIDDEN; i += 16)
+  {
+    __m256i * values = reinterpret_cast<__m256i *>(accumulator.values.data() + i);
+    *values = _mm256_sub_epi16(*values, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + i)));
+  }
+#else
+  for (int i = 0; i < NNUE_HIDDEN; i ++)
+    accumulator.values[i] = static_cast<std::int16_t>(accumulator.values[i] - weights[i]);
+#endif
+}
+
+/** Returns evaluation from the view of the player to move in centipawns */
+int Network::evaluate(const Accumulator & toMove, const Accumulator & other) const
+{
+  std::int32_t sum = 0;
+  const std::array<const Accumulator *, 2> halves = {&toMove, &other};
+
+#if defined(__AVX2__)
+  // Clipped activations times weights fit into 16 bits, madd adds neighbouring products into 32 bit lanes
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i max = _mm256_set1_epi16(NNUE_QA);
+  __m256i total = _mm256_setzero_si256();
+  for (int half = 0; half < 2; half ++)
+  {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16)
+    {
+      __m256i value = _mm256_load_si256(reinterpret_cast<const __m256i *>(halves[half] -> values.data() + i));
+      __m256i weight = _mm256_load_si256(reinterpret_cast<const __m256i *>(m_outputWeights.data() + half * NNUE_HIDDEN + i));
+      value = _mm256_min_epi16(_mm256_max_epi16(value, zero), max);
+      total = _mm256_add_epi32(total, _mm256_madd_epi16(value, weight));
+    }
+  }
+  __m128i lanes = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+  lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+  lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+  sum = _mm_cvtsi128_si32(lanes);
+#else
+  for (int half = 0; half < 2; half ++)
+  {
+    for (int i = 0; i < NNUE_HIDDEN; i ++)
+    {
+      int value = std::clamp(static_cast<int>(halves[half] -> values[i]), 0, NNUE_QA);
+      sum += value * m_outputWeights[half * NNUE_HIDDEN + i];
+    }
+  }
+#endif
+
+  return static_cast<int>((static_cast<std::int64_t>(sum) + m_outputBias) * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+}
@@ -0,0 +1,78 @@
+/**
+ * @file nnue.hpp
+ * @author Ondrej
+ * @brief Efficiently updatable neural network evaluation, loaded from file
+ *
+*/
+
+#pragma once
+
+#include "bitboard.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Neurons of the hidden layer, each player (perspective) has its own half of the same size
+constexpr int NNUE_HIDDEN = 128;
+
+// Kinds of pieces in features, own and enemy queen, rook, bishop, knight and pawn (kings are given by the king square)
+constexpr int NNUE_PIECE_KINDS = 10;
+
+/* Quantization of the network. Hidden activations are clipped to 0..NNUE_QA, output weights are multiplied by NNUE_QB,
+   output of the network times NNUE_SCALE / (NNUE_QA * NNUE_QB) is evaluation in centipawns */
+constexpr int NNUE_QA = 255;
+constexpr int NNUE_QB = 64;
+constexpr int NNUE_SCALE = 400;
+
+// Hidden layer of one perspective before activation, updated with every piece put on or removed from the board
+struct Accumulator
+{
+  alignas(32) std::array<std::int16_t, NNUE_HIDDEN> values;
+};
+
+/* Network with one hidden layer. Features are (own king square, piece kind, square) seen from one player, black sees
+   the board mirrored vertically so both players share the weights. The first layer (feature transformer) is never run
+   as a whole, accumulators of both players are kept up to date by adding and subtracting rows of features of moved
+   pieces. Only the small output layer runs at every evaluation.
+
+   File is a NetworkHeader followed by little endian int16 biases and weights (feature by feature) of the hidden layer,
+   int8 weights of the output layer (player to move first) and int32 output bias */
+class Network
+{
+  public:
+    /** Loads the network, returns false if the file is missing, damaged or made for different board */
+    bool load(const std::string & filename, int width, int height);
+
+    /** Sets accumulator to the biases (position without pieces) */
+    void reset(Accumulator & accumulator) const;
+
+    /** Adds feature to accumulator */
+    void addFeature(Accumulator & accumulator, size_t feature) const;
+
+    /** Subtracts feature from accumulator */
+    void removeFeature(Accumulator & accumulator, size_t feature) const;
+
+    /** Returns evaluation from the view of the player to move in centipawns */
+    int evaluate(const Accumulator & toMove, const Accumulator & other) const;
+
+  private:
+    // Hidden layer weights indexed by feature * NNUE_HIDDEN + neuron
+    std::vector<std::int16_t> m_hiddenWeights;
+    std::array<std::int16_t, NNUE_HIDDEN> m_hiddenBiases = {};
+
+    // Output weights widened from int8, player to move first
+    alignas(32) std::array<std::int16_t, 2 * NNUE_HIDDEN> m_outputWeights = {};
+    std::int32_t m_outputBias = 0;
+};
+
+// Start of every network file
+struct NetworkHeader
+{
+  std::array<char, 4> magic = {'M', 'C', 'N', 'N'};
+  std::uint16_t width = 0;
+  std::uint16_t height = 0;
+  std::uint32_t hidden = NNUE_HIDDEN;
+};
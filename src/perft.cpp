@@ -0,0 +1,173 @@
+/**
+ * @file perft.cpp
+ * @author Ondrej
+ * @brief Counts leaf positions of the move tree to validate and benchmark move generation
+ *
+*/
+
+#include "chess.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Options from the command line
+struct PerftOptions
+{
+  int depth = 0;
+  int threads = 1;
+  bool divide = false;
+  bool bulk = false;
+
+  // Empty for the starting position
+  std::string fen;
+};
+
+/** Counts leaf positions to given depth, bulk counting returns number of moves at the last ply without making them */
+template <int Width, int Height>
+static std::uint64_t perft(Chess<Width, Height> & game, int depth, bool bulk)
+{
+  if (depth == 0)
+    return 1;
+
+  MoveList moves = game.findMoves();
+  if (bulk && depth == 1)
+    return moves.size();
+
+  std::uint64_t nodes = 0;
+  for (Move move: moves)
+  {
+    game.makeMove(move);
+    nodes += perft(game, depth - 1, bulk);
+    game.undo();
+  }
+  return nodes;
+}
+
+/** Counts leaf positions on board of given size and prints the results, returns false if the FEN is invalid */
+template <int Width, int Height>
+static bool run(const PerftOptions & options)
+{
+  Chess<Width, Height> game;
+  if (!options.fen.empty() && !game.loadFen(options.fen))
+    return false;
+
+  auto start = std::chrono::steady_clock::now();
+
+  // Root moves are split between threads, each thread takes the next unsearched one
+  MoveList moves = game.findMoves();
+  std::vector<std::uint64_t> counts(moves.size(), 0);
+  std::atomic<size_t> next = 0;
+  auto worker = [&]()
+  {
+    Chess<Width, Height> copy = game;
+    for (size_t i = next ++; i < moves.size(); i = next ++)
+    {
+      copy.makeMove(moves[i]);
+      counts[i] = perft(copy, options.depth - 1, options.bulk);
+      copy.undo();
+    }
+  };
+
+  std::uint64_t nodes = 0;
+  if (options.depth == 0)
+    nodes = 1;
+  else
+  {
+    std::vector<std::thread> pool;
+    for (int i = 1; i < options.threads; i ++)
+      pool.emplace_back(worker);
+    worker();
+    for (auto & thread: pool)
+      thread.join();
+
+    for (size_t i = 0; i < moves.size(); i ++)
+    {
+      if (options.divide)
+        std::cout << game.moveToString(moves[i]) << ": " << counts[i] << std::endl;
+      nodes += counts[i];
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::endl << "Position: " << game.fen() << " (" << Width << "x" << Height << ")" << std::endl
+            << "Depth:    " << options.depth << std::endl
+            << "Nodes:    " << nodes << std::endl
+            << "Time:     " << seconds << " s" << std::endl
+            << "NPS:      " << static_cast<std::uint64_t>(seconds > 0 ? nodes / seconds : 0) << std::endl;
+  return true;
+}
+
+/** Prints how to use the program */
+static void printUsage(void)
+{
+  std::cerr << "Usage: perft <depth> [-fen \"<fen>\"] [-size <n>] [-divide] [-bulk] [-threads <n>]" << std::endl
+            << "  -fen      start from given position, its ranks give the board size (default is the GUI starting position)" << std::endl
+            << "  -size     starting position of n x n board, " << MIN_BOARD_SIZE << " to " << MAX_BOARD_SIZE << " (default " << DEFAULT_BOARD_SIZE << ")" << std::endl
+            << "  -divide   print number of leaf positions after each root move" << std::endl
+            << "  -bulk     count moves at the last ply instead of making them" << std::endl
+            << "  -threads  split root moves between n threads" << std::endl;
+}
+
+/**
+ * @ Counts leaf positions and reports nodes per second
+ * - Arguments : depth and options described in printUsage
+*/
+int main(int argc, char ** argv)
+{
+  PerftOptions options;
+  int size = DEFAULT_BOARD_SIZE;
+
+  if (argc < 2)
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  std::istringstream parse(argv[1]);
+  if (!(parse >> options.depth) || options.depth < 0)
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 2; i < argc; i ++)
+  {
+    std::string arg = argv[i];
+    int height = 0;
+    if (arg == "-divide")
+      options.divide = true;
+    else if (arg == "-bulk")
+      options.bulk = true;
+    else if (arg == "-fen" && i + 1 < argc && fenBoardSize(argv[i + 1], size, height) && size == height)
+      options.fen = argv[++ i];
+    else if (arg == "-size" && i + 1 < argc && std::istringstream(argv[i + 1]) >> size)
+      i ++;
+    else if (arg == "-threads" && i + 1 < argc && std::istringstream(argv[i + 1]) >> options.threads && options.threads > 0)
+      i ++;
+    else
+    {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Board size comes from the FEN (or -size for the starting position)
+  bool valid = false;
+  withBoardSize(size, size, [&]<int Width, int Height>(Board<Width, Height>)
+  {
+    valid = run<Width, Height>(options);
+  });
+  if (!valid)
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file pieceSquareTables.hpp
+ * @author Ondrej
+ * @brief Positional bonus of each piece on each square in middlegame and endgame, generated for every board size
+ *
+*/
+
+#pragma once
+
+#include "bitboard.hpp"
+#include "evaluation.hpp"
+
+#include <array>
+
+// Bonus in centipawns for each piece on each square, indexed by [Color][PieceType][Square] (PieceType order)
+template <int SquareCount>
+using PieceSquareTable = std::array<std::array<std::array<TaperedScore, SquareCount>, 6>, 2>;
+
+/** Generates the tables from board geometry (at compile time). Black uses the white table mirrored vertically */
+template <int Width, int Height>
+constexpr PieceSquareTable<Width * Height> makePieceSquareTables(void)
+{
+  using B = Board<Width, Height>;
+  PieceSquareTable<Width * Height> tables = {};
+  for (Square sq = 0; sq < B::SQUARE_COUNT; sq ++)
+  {
+    int x = B::fileOf(sq);
+    int y = B::rankOf(sq);
+
+    // Distance from the middle of the board in half squares, centrality is 0 in the corners
+    int dx = (2 * x > Width - 1) ? 2 * x - (Width - 1) : (Width - 1) - 2 * x;
+    int dy = (2 * y > Height - 1) ? 2 * y - (Height - 1) : (Height - 1) - 2 * y;
+    int centrality = (Width - 1 + Height - 1 - dx - dy) / 2;
+
+    std::array<TaperedScore, 6> bonus = {};
+    // King hides on its first rank while there are pieces to attack it, in the endgame it walks to the middle
+    bonus[0] = {(y == 0) ? 0 : -10 * y - 5 * centrality, 10 * centrality};
+    // Queen, bishop and knight reach more squares from the middle, knight the most
+    bonus[1] = {2 * centrality, 4 * centrality};
+    bonus[3] = {4 * centrality, 3 * centrality};
+    bonus[4] = {8 * centrality - 10, 6 * centrality - 10};
+    // Rook on the second rank of the opponent attacks its pawns and confines its king
+    bonus[2] = (y == Height - 2) ? TaperedScore{10, 15} : TaperedScore{0, 0};
+    // Advanced pawns cramp the opponent, but pawn on the last rank does not promote and can never move again
+    int advance = (y > 1) ? y - 1 : 0;
+    bonus[5] = (y == Height - 1) ? TaperedScore{-10, -20} : TaperedScore{10 * advance, 20 * advance};
+
+    Square mirrored = B::makeSquare(x, Height - 1 - y);
+    for (int type = 0; type < 6; type ++)
+    {
+      tables[0][type][sq] = bonus[type];
+      tables[1][type][mirrored] = bonus[type];
+    }
+  }
+  return tables;
+}
+
+// Tables of board with given size
+template <int Width, int Height>
+constexpr PieceSquareTable<Width * Height> PIECE_SQUARE = makePieceSquareTables<Width, Height>();
@@ -0,0 +1,257 @@
+/**
+ * @file tablebase.cpp
+ * @author Ondrej
+ * @brief Endgame tablebases with exact results and distance to mate, probed from memory mapped files
+ *
+*/
+
+#include "tablebase.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Letters of pieces indexed by PieceType
+static const std::string PIECE_LETTERS = "KQRBNP";
+
+/** Parses name like KRvKR (white pieces first), returns false if the name is invalid */
+bool Material::parse(const std::string & name)
+{
+  counts = {};
+  int color = 0;
+  for (char c: name)
+  {
+    if (c == 'v' && color == 0)
+    {
+      color = 1;
+      continue;
+    }
+    size_t type = PIECE_LETTERS.find(c);
+    if (type == std::string::npos)
+      return false;
+    counts[color][type] ++;
+  }
+
+  // Both players need exactly one king
+  return color == 1 && counts[0][0] == 1 && counts[1][0] == 1 && this -> pieceCount() <= TABLEBASE_MAX_PIECES;
+}
+
+/** Returns name like KRvKR */
+std::string Material::name(void) const
+{
+  std::string name;
+  for (int color = 0; color < 2; color ++)
+  {
+    if (color == 1)
+      name += 'v';
+    for (int type = 0; type < 6; type ++)
+      name += std::string(counts[color][type], PIECE_LETTERS[type]);
+  }
+  return name;
+}
+
+/** Returns key identifying the material (4 bits per count) */
+std::uint64_t Material::key(void) const
+{
+  std::uint64_t key = 0;
+  for (int color = 0; color < 2; color ++)
+    for (int type = 0; type < 6; type ++)
+      key |= static_cast<std::uint64_t>(counts[color][type] & 15) << (4 * (color * 6 + type));
+  return key;
+}
+
+/** Returns number of all pieces */
+int Material::pieceCount(void) const
+{
+  int count = 0;
+  for (const auto & color: counts)
+    for (int n: color)
+      count += n;
+  return count;
+}
+
+TablebaseIndex::TablebaseIndex(const Material & material, int squareCount)
+  : m_squareCount(squareCount)
+{
+  m_size = 2;
+  for (int color = 0; color < 2; color ++)
+  {
+    for (int type = 0; type < 6; type ++)
+    {
+      int count = material.counts[color][type];
+      if (count == 0)
+        continue;
+
+      Group group = {m_pieceCount, count, BINOMIAL[squareCount][count], static_cast<Color>(color), static_cast<PieceType>(type)};
+      for (int i = 0; i < count; i ++)
+        m_pieces[m_pieceCount ++] = {group.color, group.type};
+      m_groups.push_back(group);
+      m_size *= group.size;
+    }
+  }
+}
+
+/** Returns index of the placement */
+size_t TablebaseIndex::index(const Placement & placement) const
+{
+  size_t index = 0;
+  size_t multiplier = 1;
+  for (const Group & group: m_groups)
+  {
+    // Squares of the group have to be sorted, so all orders of identical pieces give the same index
+    std::array<Square, TABLEBASE_MAX_PIECES> squares;
+    for (int i = 0; i < group.count; i ++)
+    {
+      Square sq = placement.squares[group.first + i];
+      int j = i;
+      for (; j > 0 && squares[j - 1] > sq; j --)
+        squares[j] = squares[j - 1];
+      squares[j] = sq;
+    }
+
+    size_t groupIndex = 0;
+    for (int i = 0; i < group.count; i ++)
+      groupIndex += BINOMIAL[squares[i]][i + 1];
+    index += groupIndex * multiplier;
+    multiplier *= group.size;
+  }
+  return static_cast<size_t>(placement.toMove) + 2 * index;
+}
+
+/** Fills placement of given index, returns false if two pieces share a square */
+bool TablebaseIndex::placement(size_t index, Placement & placement) const
+{
+  placement.toMove = static_cast<Color>(index & 1);
+  index >>= 1;
+
+  Bitboard occupied = 0;
+  for (const Group & group: m_groups)
+  {
+    size_t groupIndex = index % group.size;
+    index /= group.size;
+
+    // Highest square first, each is the largest one whose coefficient still fits
+    Square sq = m_squareCount;
+    for (int i = group.count; i > 0; i --)
+    {
+      do
+        sq --;
+      while (BINOMIAL[sq][i] > groupIndex);
+      groupIndex -= BINOMIAL[sq][i];
+      placement.squares[group.first + i - 1] = sq;
+
+      if (occupied & squareBB(sq))
+        return false;
+      occupied |= squareBB(sq);
+    }
+  }
+  return true;
+}
+
+/** Maps the file, check isValid afterwards (tables of other board sizes are not valid) */
+Tablebase::Tablebase(const std::string & filename, int width, int height)
+{
+  int file = open(filename.c_str(), O_RDONLY);
+  if (file < 0)
+    return;
+
+  struct stat info;
+  if (fstat(file, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(TablebaseHeader))
+  {
+    m_mappingSize = static_cast<size_t>(info.st_size);
+    m_mapping = mmap(nullptr, m_mappingSize, PROT_READ, MAP_SHARED, file, 0);
+    if (m_mapping == MAP_FAILED)
+      m_mapping = nullptr;
+  }
+  // Mapping stays valid after the file is closed
+  close(file);
+
+  if (!m_mapping)
+    return;
+
+  TablebaseHeader header;
+  std::copy_n(static_cast<const char *>(m_mapping), sizeof(header), reinterpret_cast<char *>(&header));
+  for (int color = 0; color < 2; color ++)
+    for (int type = 0; type < 6; type ++)
+      m_material.counts[color][type] = (header.materialKey >> (4 * (color * 6 + type))) & 15;
+
+  if (header.magic != TablebaseHeader().magic || header.width != width || header.height != height || m_material.pieceCount() > TABLEBASE_MAX_PIECES)
+    return;
+
+  m_index = std::make_unique<TablebaseIndex>(m_material, width * height);
+  if (header.entries != m_index -> size() || m_mappingSize != sizeof(header) + header.entries)
+    return;
+
+  m_entries = static_cast<const std::uint8_t *>(m_mapping) + sizeof(header);
+}
+
+Tablebase::~Tablebase()
+{
+  if (m_mapping)
+    munmap(m_mapping, m_mappingSize);
+}
+
+/** Finds result of position with given index, returns false if the position is invalid */
+bool Tablebase::probe(size_t index, TablebaseResult & result) const
+{
+  std::uint8_t entry = m_entries[index];
+  if (entry == TABLEBASE_INVALID)
+    return false;
+
+  if (entry == TABLEBASE_DRAW)
+  {
+    result = {Wdl::Draw, 0};
+    return true;
+  }
+
+  // Player to move gives the mate if it comes after odd number of plies
+  result.distance = entry - 1;
+  result.wdl = (result.distance % 2) ? Wdl::Win : Wdl::Loss;
+  return true;
+}
+
+/** Writes table of given material and board size to file, returns false if it can not be written */
+bool writeTablebase(const std::string & filename, const Material & material, int width, int height, const std::vector<std::uint8_t> & entries)
+{
+  std::ofstream file(filename, std::ios::binary);
+  if (!file)
+    return false;
+
+  TablebaseHeader header;
+  header.width = static_cast<std::uint16_t>(width);
+  header.height = static_cast<std::uint16_t>(height);
+  header.materialKey = material.key();
+  header.entries = entries.size();
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(entries.data()), static_cast<std::streamsize>(entries.size()));
+  return static_cast<bool>(file);
+}
+
+/** Loads all tables (*.tb) from directory, returns number of loaded tables. Must not be called during search */
+size_t Tablebases::load(const std::string & directory)
+{
+  size_t loaded = 0;
+  std::error_code error;
+  for (const auto & file: std::filesystem::directory_iterator(directory, error))
+  {
+    if (file.path().extension() != ".tb")
+      continue;
+
+    auto table = std::make_unique<Tablebase>(file.path().string(), m_width, m_height);
+    if (!table -> isValid())
+      continue;
+
+    // Only one table of each material is kept
+    std::uint64_t key = table -> material().key();
+    std::erase_if(m_tables, [key](const auto & other) {return other -> material().key() == key;});
+    m_maxPieces = std::max(m_maxPieces, table -> material().pieceCount());
+    m_tables.push_back(std::move(table));
+    loaded ++;
+  }
+  return loaded;
+}
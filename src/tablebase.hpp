@@ -0,0 +1,259 @@
+/**
+ * @file tablebase.hpp
+ * @author Ondrej
+ * @brief Endgame tablebases with exact results and distance to mate, probed from memory mapped files
+ *
+*/
+
+#pragma once
+
+#include "chess.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Most pieces (kings included) in one table
+constexpr int TABLEBASE_MAX_PIECES = 6;
+
+/* Every table entry is one byte: 0 is draw, 1 + N is mate in N plies (won if N is odd, lost if N is even, from the view
+   of the player to move) and TABLEBASE_INVALID is position that can not happen (king that can be taken, pieces on the
+   same square) */
+constexpr std::uint8_t TABLEBASE_DRAW = 0;
+constexpr std::uint8_t TABLEBASE_INVALID = 255;
+
+// Longest mate that fits into the entry
+constexpr int TABLEBASE_MAX_DTM = TABLEBASE_INVALID - 2;
+
+using BinomialTable = std::array<std::array<size_t, TABLEBASE_MAX_PIECES + 1>, MAX_SQUARES + 1>;
+
+/** Returns table of binomial coefficients, BINOMIAL[n][k] is number of ways to choose k squares out of n */
+constexpr BinomialTable binomialTable(void)
+{
+  BinomialTable table = {};
+  for (int n = 0; n <= MAX_SQUARES; n ++)
+  {
+    table[n][0] = 1;
+    for (int k = 1; k <= TABLEBASE_MAX_PIECES; k ++)
+      table[n][k] = n == 0 ? 0 : table[n - 1][k - 1] + table[n - 1][k];
+  }
+  return table;
+}
+
+constexpr BinomialTable BINOMIAL = binomialTable();
+
+// Pieces of both players, counts indexed by [Color][PieceType]
+struct Material
+{
+  std::array<std::array<int, 6>, 2> counts = {};
+
+  /** Parses name like KRvKR (white pieces first), returns false if the name is invalid */
+  bool parse(const std::string & name);
+
+  /** Returns name like KRvKR */
+  std::string name(void) const;
+
+  /** Returns key identifying the material (4 bits per count) */
+  std::uint64_t key(void) const;
+
+  /** Returns number of all pieces */
+  int pieceCount(void) const;
+
+  /** Returns material of the game */
+  template <int Width, int Height>
+  static Material of(const Chess<Width, Height> & game)
+  {
+    Material material;
+    for (int color = 0; color < 2; color ++)
+      for (int type = 0; type < 6; type ++)
+        material.counts[color][type] = popCount(game.pieces(static_cast<Color>(color), static_cast<PieceType>(type)));
+    return material;
+  }
+};
+
+// Pieces of one position stored in the order of the table groups, squares of a group can be in any order
+struct Placement
+{
+  std::array<Square, TABLEBASE_MAX_PIECES> squares = {};
+  Color toMove = Color::White;
+};
+
+/* Maps positions of given material to indices and back. Pieces of the same type and color form a group, the group of
+   k pieces is indexed by its sorted squares (combinatorial number system), so identical pieces are stored only once.
+   Index is toMove + 2 * (group indices combined) */
+class TablebaseIndex
+{
+  public:
+    TablebaseIndex(const Material & material, int squareCount);
+
+    /** Returns number of indices (positions with both players to move) */
+    size_t size(void) const
+    {
+      return m_size;
+    }
+
+    /** Returns number of pieces */
+    int pieceCount(void) const
+    {
+      return m_pieceCount;
+    }
+
+    /** Returns piece stored in given slot of the placement */
+    Piece piece(int slot) const
+    {
+      return m_pieces[slot];
+    }
+
+    /** Returns index of the placement */
+    size_t index(const Placement & placement) const;
+
+    /** Returns index of the game (material has to match) */
+    template <int Width, int Height>
+    size_t index(const Chess<Width, Height> & game) const
+    {
+      size_t index = 0;
+      size_t multiplier = 1;
+      for (const Group & group: m_groups)
+      {
+        // Bitboard gives the squares already sorted
+        Bitboard pieces = game.pieces(group.color, group.type);
+        size_t groupIndex = 0;
+        for (int i = 1; pieces; i ++)
+          groupIndex += BINOMIAL[popLsb(pieces)][i];
+        index += groupIndex * multiplier;
+        multiplier *= group.size;
+      }
+      return static_cast<size_t>(game.toMove()) + 2 * index;
+    }
+
+    /** Fills placement of given index, returns false if two pieces share a square */
+    bool placement(size_t index, Placement & placement) const;
+
+  private:
+    struct Group
+    {
+      int first;   // First slot of the group
+      int count;   // Number of pieces
+      size_t size; // Number of ways to place the pieces
+      Color color;
+      PieceType type;
+    };
+
+    std::vector<Group> m_groups;
+    std::array<Piece, TABLEBASE_MAX_PIECES> m_pieces = {};
+    int m_pieceCount = 0;
+    int m_squareCount;
+    size_t m_size = 0;
+};
+
+enum class Wdl
+{
+  Loss,
+  Draw,
+  Win
+};
+
+// Result of the position for the player to move
+struct TablebaseResult
+{
+  Wdl wdl = Wdl::Draw;
+
+  // Plies to checkmate (0 if the player to move is checkmated)
+  int distance = 0;
+};
+
+/* One table mapped into memory, file is a TablebaseHeader followed by one byte per index */
+class Tablebase
+{
+  public:
+    /** Maps the file, check isValid afterwards (tables of other board sizes are not valid) */
+    Tablebase(const std::string & filename, int width, int height);
+    ~Tablebase();
+
+    Tablebase(const Tablebase &) = delete;
+    Tablebase & operator=(const Tablebase &) = delete;
+
+    /** Returns false if the file could not be mapped or was made for different board */
+    bool isValid(void) const
+    {
+      return m_entries != nullptr;
+    }
+
+    const Material & material(void) const
+    {
+      return m_material;
+    }
+
+    /** Finds result of the game (material has to match), returns false if the position is invalid */
+    template <int Width, int Height>
+    bool probe(const Chess<Width, Height> & game, TablebaseResult & result) const
+    {
+      return this -> probe(m_index -> index(game), result);
+    }
+
+    /** Finds result of position with given index, returns false if the position is invalid */
+    bool probe(size_t index, TablebaseResult & result) const;
+
+  private:
+    Material m_material;
+    std::unique_ptr<TablebaseIndex> m_index;
+    void * m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+    const std::uint8_t * m_entries = nullptr;
+};
+
+// Start of every table file
+struct TablebaseHeader
+{
+  std::array<char, 4> magic = {'M', 'C', 'T', 'B'};
+  std::uint16_t width = 0;
+  std::uint16_t height = 0;
+  std::uint64_t materialKey = 0;
+  std::uint64_t entries = 0;
+};
+
+/** Writes table of given material and board size to file, returns false if it can not be written */
+bool writeTablebase(const std::string & filename, const Material & material, int width, int height, const std::vector<std::uint8_t> & entries);
+
+/* All loaded tables of one board size, read only during search so threads can share it */
+class Tablebases
+{
+  public:
+    Tablebases(int width, int height)
+      : m_width(width), m_height(height)
+    {};
+
+    /** Loads all tables (*.tb) from directory, returns number of loaded tables. Must not be called during search */
+    size_t load(const std::string & directory);
+
+    /** Returns most pieces of loaded tables (0 if none is loaded) */
+    int maxPieces(void) const
+    {
+      return m_maxPieces;
+    }
+
+    /** Finds result of the game, returns false if there is no table for its material */
+    template <int Width, int Height>
+    bool probe(const Chess<Width, Height> & game, TablebaseResult & result) const
+    {
+      if (popCount(game.occupied()) > m_maxPieces)
+        return false;
+
+      std::uint64_t key = Material::of(game).key();
+      for (const auto & table: m_tables)
+      {
+        if (table -> material().key() == key)
+          return table -> probe(game, result);
+      }
+      return false;
+    }
+
+  private:
+    std::vector<std::unique_ptr<Tablebase>> m_tables;
+    int m_width;
+    int m_height;
+    int m_maxPieces = 0;
+};
@@ -0,0 +1,494 @@
+/**
+ * @file tbgen.cpp
+ * @author Ondrej
+ * @brief Generates endgame tablebases by retrograde analysis
+ *
+*/
+
+#include "tablebase.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tables generated in this run, indexed by material key
+using TableMap = std::map<std::uint64_t, std::vector<std::uint8_t>>;
+
+/** Calls job(begin, end, thread) on chunks of [0, count), each thread takes the next unprocessed chunk */
+template <typename Job>
+static void parallelFor(size_t count, int threads, const Job & job)
+{
+  constexpr size_t CHUNK = 4096;
+  std::atomic<size_t> next = 0;
+  auto worker = [&](int thread)
+  {
+    for (size_t begin = next.fetch_add(CHUNK); begin < count; begin = next.fetch_add(CHUNK))
+      job(begin, std::min(begin + CHUNK, count), thread);
+  };
+
+  std::vector<std::thread> pool;
+  for (int thread = 1; thread < threads; thread ++)
+    pool.emplace_back(worker, thread);
+  worker(0);
+  for (auto & thread: pool)
+    thread.join();
+}
+
+/* Solves one material. Positions are solved in order of their distance to mate: checkmates first, then level by level
+   the positions one move before the last solved ones (found by taking moves back). Each candidate is checked by making
+   all its moves, it is won if some move leads to a lost position and lost if all moves lead to won positions. Captures
+   lead to smaller tables that have to be generated first. Whatever is left unsolved at the end is a draw */
+template <int Width, int Height>
+class Generator
+{
+  public:
+    using Game = Chess<Width, Height>;
+    using B = Board<Width, Height>;
+    using Tables = Attacks<Width, Height>;
+
+    Generator(const Material & material, const TableMap & tables, int threads)
+      : m_index(material, B::SQUARE_COUNT), m_threads(threads)
+    {
+      // Moves are taken back with the sliding attacks before any game of the size is created
+      Tables::init();
+      for (int color = 0; color < 2; color ++)
+      {
+        for (int type = 1; type < 6; type ++)
+        {
+          if (material.counts[color][type] == 0)
+            continue;
+          Material smaller = material;
+          smaller.counts[color][type] --;
+          m_captures[color][type] = std::make_unique<Capture>(smaller, &tables.at(smaller.key()));
+        }
+      }
+    }
+
+    /** Solves all positions, returns false if some mate is too long to be stored */
+    bool generate(std::vector<std::uint8_t> & entries)
+    {
+      m_entries.assign(m_index.size(), TABLEBASE_DRAW);
+
+      // Checkmates and positions that are decided by a capture
+      std::vector<std::vector<size_t>> mates(m_threads);
+      std::vector<std::vector<std::pair<int, size_t>>> seeds(m_threads);
+      parallelFor(m_index.size(), m_threads, [&](size_t begin, size_t end, int thread)
+      {
+        for (size_t index = begin; index < end; index ++)
+          this -> initialize(index, mates[thread], seeds[thread]);
+      });
+
+      std::vector<size_t> solved;
+      for (const auto & list: mates)
+        solved.insert(solved.end(), list.begin(), list.end());
+
+      std::vector<std::vector<size_t>> seedsByLevel;
+      for (const auto & list: seeds)
+      {
+        for (const auto & [level, index]: list)
+        {
+          if (static_cast<size_t>(level) >= seedsByLevel.size())
+            seedsByLevel.resize(level + 1);
+          seedsByLevel[level].push_back(index);
+        }
+      }
+
+      seedsByLevel.emplace_back();
+      for (int level = 1; !solved.empty() || static_cast<size_t>(level) < seedsByLevel.size(); level ++)
+      {
+        // Last list is always empty
+        const std::vector<size_t> & seeded = seedsByLevel[std::min<size_t>(level, seedsByLevel.size() - 1)];
+
+        // Entries are not written while the threads read them, results are collected and stored after
+        std::vector<std::vector<std::pair<size_t, std::uint8_t>>> results(m_threads);
+        parallelFor(solved.size() + seeded.size(), m_threads, [&](size_t begin, size_t end, int thread)
+        {
+          std::uint8_t value;
+          for (size_t i = begin; i < end; i ++)
+          {
+            if (i >= solved.size())
+            {
+              size_t index = seeded[i - solved.size()];
+              if (this -> evaluate(index, level, value))
+                results[thread].push_back({index, value});
+              continue;
+            }
+
+            this -> predecessors(solved[i], [&](size_t index)
+            {
+              if (this -> evaluate(index, level, value))
+                results[thread].push_back({index, value});
+            });
+          }
+        });
+
+        solved.clear();
+        for (const auto & list: results)
+        {
+          for (const auto & [index, value]: list)
+          {
+            // Same position can be reached from more solved positions
+            if (m_entries[index] != TABLEBASE_DRAW)
+              continue;
+            if (level > TABLEBASE_MAX_DTM)
+              return false;
+            m_entries[index] = value;
+            solved.push_back(index);
+          }
+        }
+      }
+
+      entries = std::move(m_entries);
+      return true;
+    }
+
+  private:
+    // Table reached by capturing one piece
+    struct Capture
+    {
+      Capture(const Material & material, const std::vector<std::uint8_t> * entries)
+        : index(material, B::SQUARE_COUNT), entries(entries)
+      {};
+
+      TablebaseIndex index;
+      const std::vector<std::uint8_t> * entries;
+    };
+
+    /** Returns game of the placement */
+    Game game(const Placement & placement) const
+    {
+      std::array<std::pair<Square, Piece>, TABLEBASE_MAX_PIECES> pieces;
+      for (int slot = 0; slot < m_index.pieceCount(); slot ++)
+        pieces[slot] = {placement.squares[slot], m_index.piece(slot)};
+      return Game(std::span(pieces.data(), m_index.pieceCount()), placement.toMove);
+    }
+
+    /** Returns entry of the position after the move */
+    std::uint8_t childEntry(Game & game, Move move) const
+    {
+      std::uint8_t entry;
+      if (move.isCapture())
+      {
+        Piece victim = game.pieceAt(move.to());
+        const Capture & capture = *m_captures[static_cast<int>(victim.color)][static_cast<int>(victim.type)];
+        game.makeMove(move);
+        entry = (*capture.entries)[capture.index.index(game)];
+      }
+      else
+      {
+        game.makeMove(move);
+        entry = m_entries[m_index.index(game)];
+      }
+      game.undo();
+      return entry;
+    }
+
+    /** Marks invalid positions and checkmates, positions decided by a capture are seeded at the level they get solved */
+    void initialize(size_t index, std::vector<size_t> & mates, std::vector<std::pair<int, size_t>> & seeds)
+    {
+      Placement placement;
+      if (!m_index.placement(index, placement))
+      {
+        m_entries[index] = TABLEBASE_INVALID;
+        return;
+      }
+
+      // Player that just moved can not be in check
+      Game game = this -> game(placement);
+      if (game.isInCheck(opposite(game.toMove())))
+      {
+        m_entries[index] = TABLEBASE_INVALID;
+        return;
+      }
+
+      MoveList moves = game.findMoves();
+      if (moves.empty())
+      {
+        // Stalemate stays a draw
+        if (game.isChecking())
+        {
+          m_entries[index] = 1;
+          mates.push_back(index);
+        }
+        return;
+      }
+
+      int winLevel = 0;
+      int lossLevel = 0;
+      bool allWon = true;
+      for (Move move: moves)
+      {
+        if (!move.isCapture())
+          continue;
+
+        std::uint8_t entry = this -> childEntry(game, move);
+        if (entry == TABLEBASE_DRAW || entry == TABLEBASE_INVALID)
+        {
+          allWon = false;
+          continue;
+        }
+
+        // Opponent is lost after the capture, or wins after it
+        int distance = entry - 1;
+        if (distance % 2 == 0)
+          winLevel = winLevel ? std::min(winLevel, distance + 1) : distance + 1;
+        else
+          lossLevel = std::max(lossLevel, distance + 1);
+      }
+
+      if (winLevel)
+        seeds.push_back({winLevel, index});
+      else if (allWon && lossLevel)
+        seeds.push_back({lossLevel, index});
+    }
+
+    /** Checks if unsolved position is won or lost in level plies, positions up to level - 1 plies have to be solved */
+    bool evaluate(size_t index, int level, std::uint8_t & value) const
+    {
+      if (m_entries[index] != TABLEBASE_DRAW)
+        return false;
+
+      Placement placement;
+      m_index.placement(index, placement);
+      Game game = this -> game(placement);
+      MoveList moves = game.findMoves();
+      if (moves.empty())
+        return false;
+
+      bool allWon = true;
+      for (Move move: moves)
+      {
+        std::uint8_t entry = this -> childEntry(game, move);
+        int distance = entry - 1;
+        if (entry == TABLEBASE_DRAW || entry == TABLEBASE_INVALID || distance >= level)
+        {
+          allWon = false;
+          continue;
+        }
+
+        // Opponent is lost after the move
+        if (distance % 2 == 0)
+        {
+          value = static_cast<std::uint8_t>(level + 1);
+          return true;
+        }
+      }
+
+      if (!allWon)
+        return false;
+      value = static_cast<std::uint8_t>(level + 1);
+      return true;
+    }
+
+    /** Calls callback with index of every position from which a quiet move leads to the given one */
+    template <typename Callback>
+    void predecessors(size_t index, const Callback & callback) const
+    {
+      Placement placement;
+      m_index.placement(index, placement);
+      Color mover = opposite(placement.toMove);
+
+      Bitboard occupied = 0;
+      for (int slot = 0; slot < m_index.pieceCount(); slot ++)
+        occupied |= squareBB(placement.squares[slot]);
+
+      for (int slot = 0; slot < m_index.pieceCount(); slot ++)
+      {
+        Piece piece = m_index.piece(slot);
+        if (piece.color != mover)
+          continue;
+
+        // Pieces other than pawns move back the same way they move forward
+        Square sq = placement.squares[slot];
+        Bitboard origins = 0;
+        switch (piece.type)
+        {
+          case PieceType::King:
+            origins = Tables::KING[sq];
+            break;
+
+          case PieceType::Queen:
+            origins = Tables::queen(sq, occupied);
+            break;
+
+          case PieceType::Rook:
+            origins = Tables::rook(sq, occupied);
+            break;
+
+          case PieceType::Bishop:
+            origins = Tables::bishop(sq, occupied);
+            break;
+
+          case PieceType::Knight:
+            origins = Tables::KNIGHT[sq];
+            break;
+
+          case PieceType::Pawn:
+          {
+            // One square back, or two squares back to the starting row
+            int back = (mover == Color::White) ? -Width : Width;
+            int twoSquaresRank = (mover == Color::White) ? 3 : Height - 4;
+            Square one = sq + back;
+            if (one >= 0 && one < B::SQUARE_COUNT && !(occupied & squareBB(one)))
+            {
+              origins |= squareBB(one);
+              if (B::rankOf(sq) == twoSquaresRank)
+                origins |= squareBB(one + back);
+            }
+            break;
+          }
+
+          default:
+            break;
+        }
+        origins &= ~occupied;
+
+        while (origins)
+        {
+          Placement previous = placement;
+          previous.squares[slot] = popLsb(origins);
+          previous.toMove = mover;
+          callback(m_index.index(previous));
+        }
+      }
+    }
+
+    TablebaseIndex m_index;
+    int m_threads;
+    std::vector<std::uint8_t> m_entries;
+
+    // Tables after capturing piece, indexed by [Color][PieceType] of the captured piece
+    std::array<std::array<std::unique_ptr<Capture>, 6>, 2> m_captures;
+};
+
+/** Generates table of the material and all smaller tables it needs, writes them into directory */
+template <int Width, int Height>
+static bool generateAll(const Material & material, TableMap & tables, int threads, const std::string & directory)
+{
+  if (tables.count(material.key()))
+    return true;
+
+  for (int color = 0; color < 2; color ++)
+  {
+    for (int type = 1; type < 6; type ++)
+    {
+      if (material.counts[color][type] == 0)
+        continue;
+      Material smaller = material;
+      smaller.counts[color][type] --;
+      if (!generateAll<Width, Height>(smaller, tables, threads, directory))
+        return false;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::uint8_t> entries;
+  if (!Generator<Width, Height>(material, tables, threads).generate(entries))
+  {
+    std::cerr << material.name() << ": mate is longer than " << TABLEBASE_MAX_DTM << " plies" << std::endl;
+    return false;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Tables of different board sizes can share the directory
+  std::string name = material.name() + "." + std::to_string(Width) + "x" + std::to_string(Height) + ".tb";
+  std::string filename = (std::filesystem::path(directory) / name).string();
+  if (!writeTablebase(filename, material, Width, Height, entries))
+  {
+    std::cerr << "Can not write " << filename << std::endl;
+    return false;
+  }
+
+  // Results with white to move (even indices)
+  size_t wins = 0, draws = 0, losses = 0, valid = 0;
+  int longest = 0;
+  for (size_t index = 0; index < entries.size(); index += 2)
+  {
+    std::uint8_t entry = entries[index];
+    if (entry == TABLEBASE_INVALID)
+      continue;
+    valid ++;
+    if (entry == TABLEBASE_DRAW)
+      draws ++;
+    else if ((entry - 1) % 2)
+      wins ++;
+    else
+      losses ++;
+    if (entry != TABLEBASE_DRAW)
+      longest = std::max(longest, entry - 1);
+  }
+
+  std::cout << std::left << std::setw(10) << material.name() << std::right << std::setw(10) << valid << " positions (white to move)  "
+            << "won " << wins << ", drawn " << draws << ", lost " << losses << ", longest mate " << longest << " plies, "
+            << std::fixed << std::setprecision(2) << seconds << " s" << std::endl;
+
+  tables[material.key()] = std::move(entries);
+  return true;
+}
+
+/** Prints how to use the program */
+static void printUsage(void)
+{
+  std::cerr << "Usage: tbgen <material> [-size <n>] [-threads <n>] [-out <directory>]" << std::endl
+            << "  material   pieces of white and black, e.g. KRvKR or KRRRvK (kings included)" << std::endl
+            << "  -size      board is n x n squares, " << MIN_BOARD_SIZE << " to " << MAX_BOARD_SIZE << " (default " << DEFAULT_BOARD_SIZE << ")" << std::endl
+            << "  -threads   number of threads (default is number of cores)" << std::endl
+            << "  -out       directory for the tables (default tablebases)" << std::endl;
+}
+
+/**
+ * @ Generates tablebase of given material and all smaller ones it depends on
+ * - Arguments : material and options described in printUsage
+*/
+int main(int argc, char ** argv)
+{
+  Material material;
+  if (argc < 2 || !material.parse(argv[1]))
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  int size = DEFAULT_BOARD_SIZE;
+  std::string directory = "tablebases";
+  for (int i = 2; i < argc; i ++)
+  {
+    std::string arg = argv[i];
+    if (arg == "-size" && i + 1 < argc && std::istringstream(argv[i + 1]) >> size && isSupportedBoard(size, size))
+      i ++;
+    else if (arg == "-threads" && i + 1 < argc && std::istringstream(argv[i + 1]) >> threads && threads > 0)
+      i ++;
+    else if (arg == "-out" && i + 1 < argc)
+      directory = argv[++ i];
+    else
+    {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  if (error)
+  {
+    std::cerr << "Can not create " << directory << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  TableMap tables;
+  bool success = false;
+  withBoardSize(size, size, [&]<int Width, int Height>(Board<Width, Height>)
+  {
+    success = generateAll<Width, Height>(material, tables, threads, directory);
+  });
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file transpositionTable.cpp
+ * @author Ondrej
+ * @brief Transposition table storing results of already searched positions
+ *
+*/
+
+#include "transpositionTable.hpp"
+
+#include <algorithm>
+
+/** Constructor, size in megabytes */
+TranspositionTable::TranspositionTable(size_t megabytes)
+{
+  this -> resize(megabytes);
+}
+
+/** Changes size of the table in megabytes (clears the table), must not be called during search */
+void TranspositionTable::resize(size_t megabytes)
+{
+  // Largest power of two number of buckets that fits into the size
+  size_t count = std::max<size_t>(megabytes * 1024 * 1024 / sizeof(Bucket), 1);
+  m_bucketCount = 1;
+  while (m_bucketCount * 2 <= count)
+    m_bucketCount *= 2;
+
+  m_buckets = std::make_unique<Bucket[]>(m_bucketCount);
+  m_generation = 0;
+}
+
+/** Removes all entries, must not be called during search */
+void TranspositionTable::clear(void)
+{
+  for (size_t i = 0; i < m_bucketCount; i ++)
+  {
+    for (auto & slot: m_buckets[i].slots)
+    {
+      slot.keyXorData.store(0, std::memory_order_relaxed);
+      slot.data.store(0, std::memory_order_relaxed);
+    }
+  }
+  m_generation = 0;
+}
+
+/** Packs entry (without key) into one word */
+std::uint64_t TranspositionTable::pack(const TTEntry & entry)
+{
+  return static_cast<std::uint16_t>(entry.score)
+       | static_cast<std::uint64_t>(entry.move) << 16
+       | static_cast<std::uint64_t>(entry.depth) << 32
+       | static_cast<std::uint64_t>(entry.generation) << 40
+       | static_cast<std::uint64_t>(entry.bound) << 48;
+}
+
+/** Unpacks entry from one word */
+TTEntry TranspositionTable::unpack(std::uint64_t key, std::uint64_t data)
+{
+  TTEntry entry;
+  entry.key = key;
+  entry.score = static_cast<std::int16_t>(data & 0xFFFF);
+  entry.move = static_cast<std::uint16_t>(data >> 16);
+  entry.depth = static_cast<std::uint8_t>(data >> 32);
+  entry.generation = static_cast<std::uint8_t>(data >> 40);
+  entry.bound = static_cast<Bound>(static_cast<std::uint8_t>(data >> 48));
+  return entry;
+}
+
+/** Finds entry of the position, returns false if the position is not stored */
+bool TranspositionTable::probe(std::uint64_t key, TTEntry & entry) const
+{
+  for (const auto & slot: this -> bucket(key).slots)
+  {
+    std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.keyXorData.load(std::memory_order_relaxed) ^ data) == key && data)
+    {
+      entry = unpack(key, data);
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Stores search result of the position */
+void TranspositionTable::store(std::uint64_t key, int depth, Bound bound, int score, std::uint16_t move)
+{
+  // Worth of keeping an entry: deeper and newer entries are worth more, empty ones nothing
+  auto worth = [this](const TTEntry & entry)
+  {
+    if (entry.bound == Bound::None)
+      return -1000;
+    std::uint8_t age = m_generation - entry.generation;
+    return entry.depth - 8 * age;
+  };
+
+  // Same position is always replaced, otherwise the least worth entry in the bucket
+  Bucket & bucket = this -> bucket(key);
+  Slot * replace = nullptr;
+  TTEntry replaced;
+  for (auto & slot: bucket.slots)
+  {
+    std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+    std::uint64_t slotKey = slot.keyXorData.load(std::memory_order_relaxed) ^ data;
+    TTEntry entry = unpack(slotKey, data);
+    if (entry.bound != Bound::None && slotKey == key)
+    {
+      replace = &slot;
+      replaced = entry;
+      break;
+    }
+    if (!replace || worth(entry) < worth(replaced))
+    {
+      replace = &slot;
+      replaced = entry;
+    }
+  }
+
+  // Keep the old best move if the new search did not find any
+  if (move == 0 && replaced.key == key)
+    move = replaced.move;
+
+  TTEntry entry;
+  entry.key = key;
+  entry.score = static_cast<std::int16_t>(std::clamp(score, INT16_MIN, INT16_MAX));
+  entry.move = move;
+  entry.depth = static_cast<std::uint8_t>(std::clamp(depth, 0, 255));
+  entry.generation = m_generation;
+  entry.bound = bound;
+
+  std::uint64_t data = pack(entry);
+  replace -> keyXorData.store(key ^ data, std::memory_order_relaxed);
+  replace -> data.store(data, std::memory_order_relaxed);
+}
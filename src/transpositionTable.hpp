@@ -0,0 +1,99 @@
+/**
+ * @file transpositionTable.hpp
+ * @author Ondrej
+ * @brief Transposition table storing results of already searched positions
+ *
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <memory>
+
+// What the stored score means
+enum class Bound : std::uint8_t
+{
+  None,   // Empty entry
+  Exact,  // Exact score
+  Lower,  // Score is at least this (search failed high)
+  Upper   // Score is at most this (search failed low)
+};
+
+// Result of searching one position
+struct TTEntry
+{
+  std::uint64_t key = 0;
+  std::int16_t score = 0;
+  std::uint16_t move = 0; // Packed Move, 0 if there is no move
+  std::uint8_t depth = 0;
+  std::uint8_t generation = 0;
+  Bound bound = Bound::None;
+};
+
+/* Table is shared by all search threads without locks. Each entry is stored as two 64 bit words, the data and
+   the key xored with the data. Entry that was torn by two threads writing at the same time does not match its key
+   and is ignored (lockless hashing by Hyatt and Mann) */
+class TranspositionTable
+{
+  public:
+    /** Constructor, size in megabytes */
+    explicit TranspositionTable(size_t megabytes = 16);
+
+    /** Changes size of the table in megabytes (clears the table), must not be called during search */
+    void resize(size_t megabytes);
+
+    /** Removes all entries, must not be called during search */
+    void clear(void);
+
+    /** Starts new search, entries from older searches are replaced first. Must not be called during search */
+    void newSearch(void)
+    {
+      m_generation ++;
+    }
+
+    /** Finds entry of the position, returns false if the position is not stored */
+    bool probe(std::uint64_t key, TTEntry & entry) const;
+
+    /** Stores search result of the position */
+    void store(std::uint64_t key, int depth, Bound bound, int score, std::uint16_t move);
+
+  private:
+    // Entry as it is stored in the table
+    struct Slot
+    {
+      std::atomic<std::uint64_t> keyXorData = 0;
+      std::atomic<std::uint64_t> data = 0;
+    };
+
+    // Entries sharing one cache line
+    static constexpr size_t BUCKET_SIZE = 4;
+
+    struct alignas(64) Bucket
+    {
+      std::array<Slot, BUCKET_SIZE> slots;
+    };
+
+    static_assert(sizeof(Bucket) == 64, "Bucket has to fit into one cache line");
+
+    /** Packs entry (without key) into one word */
+    static std::uint64_t pack(const TTEntry & entry);
+
+    /** Unpacks entry from one word */
+    static TTEntry unpack(std::uint64_t key, std::uint64_t data);
+
+    /** Returns bucket the position belongs to */
+    Bucket & bucket(std::uint64_t key) const
+    {
+      return m_buckets[key & (m_bucketCount - 1)];
+    }
+
+    // Number of buckets is power of two
+    std::unique_ptr<Bucket[]> m_buckets;
+    size_t m_bucketCount = 0;
+
+    // Current search, used to find entries from older searches
+    std::uint8_t m_generation = 0;
+};
@@ -0,0 +1,387 @@
+/**
+ * @file uci.cpp
+ * @author Ondrej
+ * @brief Headless engine speaking the UCI protocol over standard input and output (no SFML needed)
+ *
+*/
+
+#include "engine.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Limits of the options offered to the GUI
+constexpr size_t MAX_HASH = 4096;
+constexpr int MAX_THREADS = 256;
+
+// Time kept in reserve for communication when moving on the clock, in milliseconds
+constexpr int MOVE_OVERHEAD = 30;
+
+// Moves the remaining time is split into when the GUI does not send movestogo
+constexpr int DEFAULT_MOVES_TO_GO = 30;
+
+static std::mutex outputMutex;
+
+/** Writes one line to standard output, lines of the search thread and of the input loop do not mix */
+static void send(const std::string & line)
+{
+  std::lock_guard<std::mutex> lock(outputMutex);
+  std::cout << line << std::endl;
+}
+
+// Settings changed by setoption, they survive switching to another board size
+struct UciOptions
+{
+  size_t hash = 16;
+  int threads = 1;
+  int boardSize = DEFAULT_BOARD_SIZE;
+};
+
+// Parameters of the go command, times are in milliseconds (-1 if not sent)
+struct GoParameters
+{
+  SearchLimits limits;
+  std::array<int, 2> time = {-1, -1};
+  std::array<int, 2> increment = {0, 0};
+  int movesToGo = 0;
+  int moveTime = -1;
+  bool infinite = false;
+};
+
+/* Engine and position of one board size. Board size is a template parameter of the engine, so the input loop talks to
+   the session through this interface and makes a new one when a position of another size comes */
+class UciSession
+{
+  public:
+    virtual ~UciSession() = default;
+
+    virtual int width(void) const = 0;
+    virtual int height(void) const = 0;
+
+    virtual void setHash(size_t megabytes) = 0;
+    virtual void setThreads(int threads) = 0;
+    virtual void newGame(void) = 0;
+
+    /** Sets position from FEN (default setup if empty) and plays the moves, returns false if any of it is invalid */
+    virtual bool setPosition(const std::string & fen, const std::vector<std::string> & moves) = 0;
+
+    /** Starts searching in the background, bestmove is sent when the search ends */
+    virtual void go(const GoParameters & parameters) = 0;
+
+    /** Stops the search and waits until bestmove is sent */
+    virtual void stop(void) = 0;
+
+    /** Opponent played the move the engine ponders on, the search goes on with its limits */
+    virtual void ponderHit(void) = 0;
+};
+
+template <int Width, int Height>
+class UciEngine : public UciSession
+{
+  public:
+    using Game = Chess<Width, Height>;
+
+    UciEngine(const UciOptions & options)
+      : m_engine(options.hash), m_game(Game::setup(), Color::White)
+    {
+      m_engine.setThreads(options.threads);
+      m_engine.setInfoCallback([](const SearchInfo & info) {send(infoLine(info));});
+    }
+
+    ~UciEngine() override
+    {
+      this -> stop();
+    }
+
+    int width(void) const override
+    {
+      return Width;
+    }
+
+    int height(void) const override
+    {
+      return Height;
+    }
+
+    void setHash(size_t megabytes) override
+    {
+      this -> stop();
+      m_engine.setHashSize(megabytes);
+    }
+
+    void setThreads(int threads) override
+    {
+      this -> stop();
+      m_engine.setThreads(threads);
+    }
+
+    void newGame(void) override
+    {
+      this -> stop();
+      m_engine.clearHash();
+    }
+
+    /** Sets position from FEN (default setup if empty) and plays the moves, returns false if any of it is invalid */
+    bool setPosition(const std::string & fen, const std::vector<std::string> & moves) override
+    {
+      this -> stop();
+      Game game(Game::setup(), Color::White);
+      if (!fen.empty() && !game.loadFen(fen))
+        return false;
+
+      for (const std::string & name: moves)
+      {
+        Move move = parseMove(game, name);
+        if (!move)
+          return false;
+        game.makeMove(move);
+      }
+      m_game = game;
+      return true;
+    }
+
+    /** Starts searching in the background, bestmove is sent when the search ends */
+    void go(const GoParameters & parameters) override
+    {
+      this -> stop();
+      SearchLimits limits = parameters.limits;
+      limits.infinite = parameters.infinite;
+      int side = static_cast<int>(m_game.toMove());
+      if (parameters.moveTime >= 0)
+        limits.time = std::chrono::milliseconds(std::max(1, parameters.moveTime - MOVE_OVERHEAD));
+      else if (parameters.time[side] >= 0 && !parameters.infinite)
+      {
+        // Equal share of the remaining time plus most of the increment, never more than what is left on the clock
+        int movesToGo = parameters.movesToGo > 0 ? parameters.movesToGo : DEFAULT_MOVES_TO_GO;
+        int budget = parameters.time[side] / movesToGo + parameters.increment[side] * 3 / 4;
+        budget = std::min(budget, parameters.time[side] - MOVE_OVERHEAD);
+        limits.time = std::chrono::milliseconds(std::max(1, budget));
+      }
+
+      m_engine.startSearch(m_game, limits, [](const SearchResult & result)
+      {
+        std::string bestMove = "bestmove " + (result.move ? moveName(result.move) : std::string("0000"));
+        if (result.ponderMove)
+          bestMove += " ponder " + moveName(result.ponderMove);
+        send(bestMove);
+      });
+    }
+
+    /** Stops the search and waits until bestmove is sent */
+    void stop(void) override
+    {
+      m_engine.stop();
+      m_engine.wait();
+    }
+
+    /** Opponent played the move the engine ponders on, the search goes on with its limits */
+    void ponderHit(void) override
+    {
+      m_engine.ponderHit();
+    }
+
+  private:
+    /** Returns move in UCI notation (pawns do not promote, so there is never the piece letter) */
+    static std::string moveName(Move move)
+    {
+      return Game::moveToString(move);
+    }
+
+    /** Returns legal move of given name (no move if there is none) */
+    static Move parseMove(const Game & game, const std::string & name)
+    {
+      for (Move move: game.findMoves())
+      {
+        if (moveName(move) == name)
+          return move;
+      }
+      return Move();
+    }
+
+    /** Returns info line with the progress of the search */
+    static std::string infoLine(const SearchInfo & info)
+    {
+      std::ostringstream line;
+      line << "info depth " << info.depth << " seldepth " << info.selectiveDepth << " score ";
+
+      // Mate scores are sent as moves (not plies) to mate, negative when getting mated
+      if (std::abs(info.score) > MATE_BOUND)
+      {
+        int plies = MATE_SCORE - std::abs(info.score);
+        line << "mate " << (info.score > 0 ? (plies + 1) / 2 : -(plies / 2));
+      }
+      else
+        line << "cp " << info.score;
+
+      std::uint64_t nps = info.elapsed.count() ? info.nodes * 1000 / info.elapsed.count() : 0;
+      line << " nodes " << info.nodes << " nps " << nps << " time " << info.elapsed.count() << " pv";
+      for (Move move: info.pv)
+        line << " " << moveName(move);
+      return line.str();
+    }
+
+    Engine<Width, Height> m_engine;
+    Game m_game;
+};
+
+/** Returns session of given board size, nullptr if the size is not supported */
+static std::unique_ptr<UciSession> makeSession(int width, int height, const UciOptions & options)
+{
+  std::unique_ptr<UciSession> session;
+  withBoardSize(width, height, [&]<int Width, int Height>(Board<Width, Height>)
+  {
+    session = std::make_unique<UciEngine<Width, Height>>(options);
+  });
+  return session;
+}
+
+/** Parses the go command */
+static GoParameters parseGo(std::istringstream & command)
+{
+  GoParameters parameters;
+  std::string token;
+  while (command >> token)
+  {
+    if (token == "depth")
+      command >> parameters.limits.depth;
+    else if (token == "nodes")
+      command >> parameters.limits.nodes;
+    else if (token == "movetime")
+      command >> parameters.moveTime;
+    else if (token == "wtime")
+      command >> parameters.time[0];
+    else if (token == "btime")
+      command >> parameters.time[1];
+    else if (token == "winc")
+      command >> parameters.increment[0];
+    else if (token == "binc")
+      command >> parameters.increment[1];
+    else if (token == "movestogo")
+      command >> parameters.movesToGo;
+    else if (token == "infinite")
+      parameters.infinite = true;
+    else if (token == "ponder")
+      parameters.limits.ponder = true;
+  }
+  parameters.limits.depth = std::clamp(parameters.limits.depth, 1, MAX_DEPTH);
+  return parameters;
+}
+
+/**
+ * @ Runs the UCI loop until quit or end of input
+ * - Argument : Board size S used by "position startpos" (S x S squares, 4 to 8), default is 5. Positions given by FEN
+ *   use the size of the FEN
+*/
+int main(int argc, char ** argv)
+{
+  UciOptions options;
+  if (argc > 2)
+    return EXIT_FAILURE;
+  if (argc == 2)
+  {
+    std::istringstream parse(argv[1]);
+    if (!(parse >> options.boardSize) || !isSupportedBoard(options.boardSize, options.boardSize))
+      return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<UciSession> session = makeSession(options.boardSize, options.boardSize, options);
+  std::string line;
+  while (std::getline(std::cin, line))
+  {
+    std::istringstream command(line);
+    std::string token;
+    command >> token;
+
+    if (token == "uci")
+    {
+      send("id name Simple Chess " + std::to_string(session -> width()) + "x" + std::to_string(session -> height()));
+      send("id author Ondrej");
+      send("option name Hash type spin default 16 min 1 max " + std::to_string(MAX_HASH));
+      send("option name Threads type spin default 1 min 1 max " + std::to_string(MAX_THREADS));
+      send("option name Ponder type check default false");
+      send("option name BoardSize type spin default " + std::to_string(DEFAULT_BOARD_SIZE) + " min " + std::to_string(MIN_BOARD_SIZE) + " max " + std::to_string(MAX_BOARD_SIZE));
+      send("uciok");
+    }
+    else if (token == "isready")
+      send("readyok");
+    else if (token == "ucinewgame")
+      session -> newGame();
+    else if (token == "setoption")
+    {
+      // setoption name <name> value <value>, names of our options have no spaces
+      std::string name;
+      std::string value;
+      command >> token >> name >> token >> value;
+      std::istringstream parse(value);
+      if (name == "Hash" && parse >> options.hash)
+      {
+        options.hash = std::clamp<size_t>(options.hash, 1, MAX_HASH);
+        session -> setHash(options.hash);
+      }
+      else if (name == "Threads" && parse >> options.threads)
+      {
+        options.threads = std::clamp(options.threads, 1, MAX_THREADS);
+        session -> setThreads(options.threads);
+      }
+      else if (name == "Ponder")
+        continue;
+      else if (name == "BoardSize" && parse >> options.boardSize && isSupportedBoard(options.boardSize, options.boardSize))
+        session = makeSession(options.boardSize, options.boardSize, options);
+      else
+        send("info string unknown option " + name);
+    }
+    else if (token == "position")
+    {
+      // position startpos | fen <fen>, both optionally followed by moves <move>...
+      std::string fen;
+      std::vector<std::string> moves;
+      command >> token;
+      if (token == "fen")
+      {
+        while (command >> token && token != "moves")
+          fen += (fen.empty() ? "" : " ") + token;
+      }
+      else
+        command >> token;
+      while (command >> token)
+        moves.push_back(token);
+
+      // Session of other board size is made for the FEN
+      int width = options.boardSize;
+      int height = options.boardSize;
+      if (!fen.empty() && !fenBoardSize(fen, width, height))
+        width = 0;
+      if (width != session -> width() || height != session -> height())
+      {
+        std::unique_ptr<UciSession> other = makeSession(width, height, options);
+        if (!other)
+        {
+          send("info string unsupported board in position " + fen);
+          continue;
+        }
+        session = std::move(other);
+      }
+
+      if (!session -> setPosition(fen, moves))
+        send("info string invalid position or move");
+    }
+    else if (token == "go")
+      session -> go(parseGo(command));
+    else if (token == "stop")
+      session -> stop();
+    else if (token == "ponderhit")
+      session -> ponderHit();
+    else if (token == "quit")
+      break;
+  }
+
+  session -> stop();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file zobrist.hpp
+ * @author Ondrej
+ * @brief Zobrist keys used for hashing chess positions
+ *
+*/
+
+#pragma once
+
+#include "bitboard.hpp"
+
+#include <array>
+#include <cstdint>
+
+template <int SquareCount>
+struct ZobristKeys
+{
+  // Key for each piece on each square, indexed by [Color][PieceType][Square]
+  std::array<std::array<std::array<std::uint64_t, SquareCount>, 6>, 2> pieces;
+
+  // Key that is added when black is to move
+  std::uint64_t blackToMove;
+};
+
+/** Generates the keys with SplitMix64 (at compile time, so they are the same on every run) */
+template <int SquareCount>
+constexpr ZobristKeys<SquareCount> makeZobristKeys(void)
+{
+  ZobristKeys<SquareCount> keys = {};
+  std::uint64_t state = 0x2545F4914F6CDD1DULL;
+  auto next = [&state]()
+  {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  };
+
+  for (auto & color: keys.pieces)
+    for (auto & type: color)
+      for (auto & key: type)
+        key = next();
+  keys.blackToMove = next();
+  return keys;
+}
+
+// Keys of board with given number of squares
+template <int SquareCount>
+constexpr ZobristKeys<SquareCount> ZOBRIST = makeZobristKeys<SquareCount>();